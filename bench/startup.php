@@ -0,0 +1,77 @@
+<?php
+/*
+  Times how long PHP takes to start and exit with the extension loaded, against a run without it.
+
+  php bench/startup.php [-n runs] path\to\php_pdo_oledb.dll [path\to\another\php_pdo_oledb.dll ...]
+
+  Pass the DLL built before a change and the one built after it to compare the two. Every run is a
+  fresh process (php -n -d extension=... -r ''), which is what a CLI tool or a short-lived CGI
+  worker pays for. The PHP binary used is the one running this script.
+*/
+
+$runs = 50;
+$dlls = array();
+for ($i = 1; $i < $argc; $i++) {
+	if ($argv[$i] == '-n' && $i + 1 < $argc) {
+		$runs = max(1, (int) $argv[++$i]);
+	} else {
+		$dlls[] = $argv[$i];
+	}
+}
+if (!$dlls) {
+	echo "usage: php startup.php [-n runs] php_pdo_oledb.dll [php_pdo_oledb.dll ...]\n";
+	exit(1);
+}
+
+function time_startup($args, $runs)
+{
+	$php = escapeshellarg(PHP_BINARY_PATH);
+	$times = array();
+	for ($i = 0; $i < $runs; $i++) {
+		$output = array();
+		$start = microtime(true);
+		exec("$php -n $args -r \"\"", $output, $status);
+		$times[] = (microtime(true) - $start) * 1000;
+		if ($status != 0) {
+			echo "php exited with status $status: " . implode("\n", $output) . "\n";
+			exit(1);
+		}
+	}
+	sort($times);
+	return array(
+		'median' => $times[(int) (count($times) / 2)],
+		'mean' => array_sum($times) / count($times),
+		'min' => $times[0],
+	);
+}
+
+/* PHP_BINARY only exists from 5.4 on */
+define('PHP_BINARY_PATH', defined('PHP_BINARY') ? PHP_BINARY : (PHP_BINDIR . DIRECTORY_SEPARATOR . (DIRECTORY_SEPARATOR == '\\' ? 'php.exe' : 'php')));
+
+/* PDO itself has to be loaded for the driver to register, unless it's built in */
+$pdo = '-d extension_dir=' . escapeshellarg(PHP_EXTENSION_DIR);
+if (is_file(PHP_EXTENSION_DIR . DIRECTORY_SEPARATOR . 'php_pdo.dll')) {
+	$pdo .= ' -d extension=php_pdo.dll';
+}
+
+$cases = array('without pdo_oledb' => $pdo);
+foreach ($dlls as $dll) {
+	if (!is_file($dll)) {
+		echo "$dll not found\n";
+		exit(1);
+	}
+	$cases[$dll] = $pdo . ' -d extension=' . escapeshellarg(realpath($dll));
+}
+
+/* one untimed pass so the first case doesn't pay for a cold disk cache */
+foreach ($cases as $args) {
+	time_startup($args, 1);
+}
+
+printf("%d runs each, milliseconds per process\n", $runs);
+printf("%-40s %10s %10s %10s\n", '', 'median', 'mean', 'min');
+foreach ($cases as $name => $args) {
+	$t = time_startup($args, $runs);
+	printf("%-40s %10.2f %10.2f %10.2f\n", substr($name, -40), $t['median'], $t['mean'], $t['min']);
+}
+?>
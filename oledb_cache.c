@@ -0,0 +1,537 @@
+/*
+  +----------------------------------------------------------------------+
+  | PHP Version 5                                                        |
+  +----------------------------------------------------------------------+
+  | Copyright (c) 1997-2007 The PHP Group                                |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 3.0 of the PHP license,       |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.php.net/license/3_0.txt.                                  |
+  | If you did not receive a copy of the PHP license and are unable to   |
+  | obtain it through the world-wide-web, please send a note to          |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Chung Leong <cleong@cal.berkeley.edu>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "php_ini.h"
+#include "ext/standard/info.h"
+#include "pdo/php_pdo.h"
+#include "pdo/php_pdo_driver.h"
+#include "php_pdo_oledb.h"
+#include "php_pdo_oledb_int.h"
+
+void oledb_create_statement_cache(pdo_oledb_statement_cache **pCache, long size, int persistent)
+{
+	pdo_oledb_statement_cache *cache = pecalloc(1, sizeof(*cache), persistent);
+	cache->persistent = persistent;
+	cache->size = size;
+	zend_hash_init(&cache->entries, 16, NULL, NULL, persistent);
+	*pCache = cache;
+}
+
+static void oledb_unlink_cached_statement(pdo_oledb_statement_cache *cache, pdo_oledb_cached_statement *entry)
+{
+	if (entry->prev) {
+		entry->prev->next = entry->next;
+	} else {
+		cache->head = entry->next;
+	}
+	if (entry->next) {
+		entry->next->prev = entry->prev;
+	} else {
+		cache->tail = entry->prev;
+	}
+	entry->prev = entry->next = NULL;
+}
+
+static void oledb_link_cached_statement(pdo_oledb_statement_cache *cache, pdo_oledb_cached_statement *entry)
+{
+	/* most recently used goes to the front */
+	entry->next = cache->head;
+	if (cache->head) {
+		cache->head->prev = entry;
+	} else {
+		cache->tail = entry;
+	}
+	cache->head = entry;
+}
+
+static void oledb_release_idle_command(pdo_oledb_statement_cache *cache, pdo_oledb_cached_statement *entry)
+{
+	if (entry->pICommand) {
+		if (entry->hAccessor) {
+			IAccessor *pIAccessor = NULL;
+			QUERY_INTERFACE(entry->pICommand, IID_IAccessor, pIAccessor);
+			if (pIAccessor) {
+				CALL(ReleaseAccessor, pIAccessor, entry->hAccessor, NULL);
+				RELEASE(pIAccessor);
+			}
+		}
+		RELEASE(entry->pICommand);
+	}
+	if (entry->bindings) {
+		pefree(entry->bindings, cache->persistent);
+	}
+	entry->pICommand = NULL;
+	entry->hAccessor = 0;
+	entry->bindings = NULL;
+	entry->bindingCount = 0;
+	entry->rowSize = 0;
+}
+
+static void oledb_free_cached_statement(pdo_oledb_statement_cache *cache, pdo_oledb_cached_statement *entry)
+{
+	zend_hash_del(&cache->entries, entry->sql, entry->sqlLen + 1);
+	oledb_unlink_cached_statement(cache, entry);
+	oledb_release_idle_command(cache, entry);
+	if (entry->paramInfo) {
+		pefree(entry->paramInfo, cache->persistent);
+	}
+	if (entry->paramNamesBuffer) {
+		pefree(entry->paramNamesBuffer, cache->persistent);
+	}
+	pefree(entry->sql, cache->persistent);
+	pefree(entry, cache->persistent);
+}
+
+void oledb_clear_statement_cache(pdo_oledb_statement_cache *cache)
+{
+	if (cache) {
+		while (cache->head) {
+			oledb_free_cached_statement(cache, cache->head);
+		}
+		/* commands checked out before now mustn't come back */
+		cache->generation++;
+	}
+}
+
+void oledb_release_idle_commands(pdo_oledb_statement_cache *cache)
+{
+	pdo_oledb_cached_statement *entry;
+
+	/* keep the parameter info, which isn't tied to the session */
+	if (cache) {
+		for (entry = cache->head; entry; entry = entry->next) {
+			oledb_release_idle_command(cache, entry);
+		}
+		cache->generation++;
+	}
+}
+
+void oledb_resize_statement_cache(pdo_oledb_statement_cache *cache, long size)
+{
+	if (cache) {
+		cache->size = max(size, 0);
+		while (cache->tail && zend_hash_num_elements(&cache->entries) > (uint) cache->size) {
+			oledb_free_cached_statement(cache, cache->tail);
+			cache->evictions++;
+		}
+	}
+}
+
+void oledb_release_statement_cache(pdo_oledb_statement_cache *cache)
+{
+	if (cache) {
+		oledb_clear_statement_cache(cache);
+		zend_hash_destroy(&cache->entries);
+		pefree(cache, cache->persistent);
+	}
+}
+
+static UINT oledb_get_parameter_names_length(DB_UPARAMS count, DBPARAMINFO *info, OLECHAR *names)
+{
+	UINT len = 0;
+	DB_UPARAMS i;
+
+	/* the names are packed one after another into the buffer */
+	for (i = 0; i < count; i++) {
+		if (info[i].pwszName) {
+			UINT end = (UINT) (info[i].pwszName - names) + wcslen(info[i].pwszName) + 1;
+			len = max(len, end);
+		}
+	}
+	return len;
+}
+
+static void oledb_copy_parameter_info(DB_UPARAMS count, DBPARAMINFO *info, OLECHAR *names, UINT names_len, DBPARAMINFO *destInfo, OLECHAR *destNames)
+{
+	DB_UPARAMS i;
+
+	memcpy(destInfo, info, count * sizeof(DBPARAMINFO));
+	if (names_len) {
+		memcpy(destNames, names, names_len * sizeof(OLECHAR));
+	}
+	for (i = 0; i < count; i++) {
+		if (info[i].pwszName) {
+			destInfo[i].pwszName = destNames + (info[i].pwszName - names);
+		}
+	}
+}
+
+HRESULT oledb_find_cached_statement(pdo_oledb_statement_cache *cache, const char *sql, int sql_len, DB_UPARAMS *pCount, DBPARAMINFO **pInfo, OLECHAR **pNames)
+{
+	pdo_oledb_cached_statement **pEntry, *entry;
+
+	if (!cache || !sql) {
+		return S_FALSE;
+	}
+	if (zend_hash_find(&cache->entries, (char *) sql, sql_len + 1, (void **) &pEntry) != SUCCESS) {
+		cache->misses++;
+		return S_FALSE;
+	}
+	entry = *pEntry;
+	oledb_unlink_cached_statement(cache, entry);
+	oledb_link_cached_statement(cache, entry);
+	cache->hits++;
+
+	/* hand out a copy in the same kind of memory the provider would have used */
+	*pCount = entry->paramCount;
+	*pInfo = NULL;
+	*pNames = NULL;
+	if (entry->paramCount) {
+		*pInfo = CoTaskMemAlloc(entry->paramCount * sizeof(DBPARAMINFO));
+		if (entry->paramNamesLen) {
+			*pNames = CoTaskMemAlloc(entry->paramNamesLen * sizeof(OLECHAR));
+		}
+		oledb_copy_parameter_info(entry->paramCount, entry->paramInfo, entry->paramNamesBuffer, entry->paramNamesLen, *pInfo, *pNames);
+	}
+	return S_OK;
+}
+
+static pdo_oledb_cached_statement *oledb_create_cached_statement(pdo_oledb_statement_cache *cache, const char *sql, int sql_len, DB_UPARAMS count, DBPARAMINFO *info, OLECHAR *names)
+{
+	pdo_oledb_cached_statement *entry;
+
+	/* make room by dropping the least recently used */
+	while (cache->tail && zend_hash_num_elements(&cache->entries) >= (uint) cache->size) {
+		oledb_free_cached_statement(cache, cache->tail);
+		cache->evictions++;
+	}
+
+	entry = pecalloc(1, sizeof(*entry), cache->persistent);
+	entry->sql = pemalloc(sql_len + 1, cache->persistent);
+	memcpy(entry->sql, sql, sql_len);
+	entry->sql[sql_len] = '\0';
+	entry->sqlLen = sql_len;
+	entry->columnCount = -1;
+	entry->paramCount = (info) ? count : 0;
+	if (entry->paramCount) {
+		entry->paramNamesLen = (names) ? oledb_get_parameter_names_length(count, info, names) : 0;
+		entry->paramInfo = pemalloc(count * sizeof(DBPARAMINFO), cache->persistent);
+		if (entry->paramNamesLen) {
+			entry->paramNamesBuffer = pemalloc(entry->paramNamesLen * sizeof(OLECHAR), cache->persistent);
+		}
+		oledb_copy_parameter_info(count, info, names, entry->paramNamesLen, entry->paramInfo, entry->paramNamesBuffer);
+	}
+
+	oledb_link_cached_statement(cache, entry);
+	zend_hash_update(&cache->entries, entry->sql, sql_len + 1, &entry, sizeof(entry), NULL);
+	return entry;
+}
+
+void oledb_add_cached_statement(pdo_oledb_statement_cache *cache, const char *sql, int sql_len, DB_UPARAMS count, DBPARAMINFO *info, OLECHAR *names)
+{
+	if (!cache || !sql || cache->size <= 0) {
+		return;
+	}
+	oledb_remove_cached_statement(cache, sql, sql_len);
+	oledb_create_cached_statement(cache, sql, sql_len, count, info, names);
+}
+
+static BOOL oledb_is_command_of_session(ICommand *pICommand, IUnknown *pSession)
+{
+	IUnknown *pCommandSession = NULL, *pUnk = NULL;
+	BOOL result = FALSE;
+
+	/* compare object identities--no round-trip to the server needed */
+	if (SUCCEEDED(CALL(GetDBSession, pICommand, &IID_IUnknown, &pCommandSession)) && pCommandSession) {
+		QUERY_INTERFACE(pSession, IID_IUnknown, pUnk);
+		result = (pUnk == pCommandSession);
+	}
+	SAFE_RELEASE(pCommandSession);
+	SAFE_RELEASE(pUnk);
+	return result;
+}
+
+BOOL oledb_checkout_cached_command(pdo_oledb_statement_cache *cache, pdo_oledb_stmt *S, IUnknown *pSession)
+{
+	pdo_oledb_cached_statement **pEntry, *entry;
+
+	if (!cache || !S->cacheKey || zend_hash_find(&cache->entries, S->cacheKey, S->cacheKeyLen + 1, (void **) &pEntry) != SUCCESS) {
+		return FALSE;
+	}
+	entry = *pEntry;
+	if (!entry->pICommand) {
+		return FALSE;
+	}
+	if (!oledb_is_command_of_session(entry->pICommand, pSession)) {
+		/* left over from a session that has since been replaced */
+		oledb_release_idle_command(cache, entry);
+		return FALSE;
+	}
+
+	/* the statement owns the command and its accessor until it gives them back */
+	S->pICommand = entry->pICommand;
+	S->hAccessorCommand = entry->hAccessor;
+	if (entry->bindings) {
+		S->commandBindings = emalloc(entry->bindingCount * sizeof(DBBINDING));
+		memcpy(S->commandBindings, entry->bindings, entry->bindingCount * sizeof(DBBINDING));
+		S->commandBindingCount = entry->bindingCount;
+		S->commandRowSize = entry->rowSize;
+		pefree(entry->bindings, cache->persistent);
+	}
+	entry->pICommand = NULL;
+	entry->hAccessor = 0;
+	entry->bindings = NULL;
+	entry->bindingCount = 0;
+	entry->rowSize = 0;
+	return TRUE;
+}
+
+void oledb_return_cached_command(pdo_oledb_statement_cache *cache, pdo_oledb_stmt *S)
+{
+	pdo_oledb_cached_statement **pEntry, *entry;
+
+	if (!cache || !S->cacheKey || !S->pICommand || cache->size <= 0 || S->cacheGeneration != cache->generation) {
+		return;
+	}
+	if (zend_hash_find(&cache->entries, S->cacheKey, S->cacheKeyLen + 1, (void **) &pEntry) == SUCCESS) {
+		entry = *pEntry;
+	} else {
+		/* it got pushed out while the command was in use */
+		entry = oledb_create_cached_statement(cache, S->cacheKey, S->cacheKeyLen, S->paramCount, S->paramInfo, S->paramNamesBuffer);
+	}
+	if (!entry->pICommand) {
+		/* keep only one idle command per statement */
+		entry->pICommand = S->pICommand;
+		ADDREF(S->pICommand);
+		if (S->hAccessorCommand && S->commandBindings) {
+			/* the accessor goes along with it */
+			entry->hAccessor = S->hAccessorCommand;
+			entry->bindings = pemalloc(S->commandBindingCount * sizeof(DBBINDING), cache->persistent);
+			memcpy(entry->bindings, S->commandBindings, S->commandBindingCount * sizeof(DBBINDING));
+			entry->bindingCount = S->commandBindingCount;
+			entry->rowSize = S->commandRowSize;
+			S->hAccessorCommand = 0;
+		}
+	}
+}
+
+void oledb_remove_cached_statement(pdo_oledb_statement_cache *cache, const char *sql, int sql_len)
+{
+	pdo_oledb_cached_statement **pEntry;
+
+	if (cache && sql && zend_hash_find(&cache->entries, (char *) sql, sql_len + 1, (void **) &pEntry) == SUCCESS) {
+		oledb_free_cached_statement(cache, *pEntry);
+	}
+}
+
+int oledb_get_cached_column_count(pdo_oledb_statement_cache *cache, const char *sql, int sql_len)
+{
+	pdo_oledb_cached_statement **pEntry;
+
+	if (cache && sql && zend_hash_find(&cache->entries, (char *) sql, sql_len + 1, (void **) &pEntry) == SUCCESS) {
+		return (*pEntry)->columnCount;
+	}
+	return -1;
+}
+
+void oledb_set_cached_column_count(pdo_oledb_statement_cache *cache, const char *sql, int sql_len, int count)
+{
+	pdo_oledb_cached_statement **pEntry;
+
+	if (cache && sql && zend_hash_find(&cache->entries, (char *) sql, sql_len + 1, (void **) &pEntry) == SUCCESS) {
+		(*pEntry)->columnCount = count;
+	}
+}
+
+void oledb_get_statement_cache_stats(pdo_oledb_statement_cache *cache, zval *val)
+{
+	pdo_oledb_cached_statement *entry;
+	long idle = 0;
+
+	for (entry = cache->head; entry; entry = entry->next) {
+		idle += (entry->pICommand != NULL);
+	}
+	array_init(val);
+	add_assoc_long(val, "size", cache->size);
+	add_assoc_long(val, "entries", zend_hash_num_elements(&cache->entries));
+	add_assoc_long(val, "idle_commands", idle);
+	add_assoc_long(val, "hits", cache->hits);
+	add_assoc_long(val, "misses", cache->misses);
+	add_assoc_long(val, "evictions", cache->evictions);
+}
+
+char *oledb_normalize_statement(const char *sql, int sql_len, int *pLen)
+{
+	char *s = emalloc(sql_len + 1), *d = s;
+	char quote = 0;
+	int space = FALSE, i;
+
+	/* collapse whitespace outside of literals, quoted identifiers and comments */
+	for (i = 0; i < sql_len; i++) {
+		char c = sql[i];
+		if (quote) {
+			if (c == quote) {
+				quote = 0;
+			}
+			*d++ = c;
+		} else if (isspace((unsigned char) c)) {
+			space = TRUE;
+		} else {
+			if (space && d > s) {
+				*d++ = ' ';
+			}
+			space = FALSE;
+			if (c == '-' && i + 1 < sql_len && sql[i + 1] == '-') {
+				/* the newline ending the comment is significant */
+				while (i < sql_len && sql[i] != '\n') {
+					*d++ = sql[i++];
+				}
+				if (i < sql_len) {
+					*d++ = '\n';
+				}
+				continue;
+			} else if (c == '/' && i + 1 < sql_len && sql[i + 1] == '*') {
+				/* keep the comment as written */
+				*d++ = sql[i++];
+				*d++ = sql[i++];
+				while (i < sql_len && !(sql[i] == '*' && i + 1 < sql_len && sql[i + 1] == '/')) {
+					*d++ = sql[i++];
+				}
+				if (i < sql_len) {
+					*d++ = sql[i++];
+					*d++ = sql[i];
+				}
+				continue;
+			} else if (c == '\'' || c == '"') {
+				quote = c;
+			} else if (c == '[') {
+				quote = ']';
+			}
+			*d++ = c;
+		}
+	}
+	*d = '\0';
+	*pLen = d - s;
+	return s;
+}
+
+static int oledb_skip_comment(const char *sql, int sql_len, int i)
+{
+	/* return the position just past a comment starting at i, or i when there isn't one */
+	if (sql[i] == '-' && i + 1 < sql_len && sql[i + 1] == '-') {
+		while (i < sql_len && sql[i] != '\n') {
+			i++;
+		}
+	} else if (sql[i] == '/' && i + 1 < sql_len && sql[i + 1] == '*') {
+		i += 2;
+		while (i < sql_len && !(sql[i] == '*' && i + 1 < sql_len && sql[i + 1] == '/')) {
+			i++;
+		}
+		i = min(i + 2, sql_len);
+	}
+	return i;
+}
+
+static int oledb_skip_to_first_word(const char *sql, int sql_len)
+{
+	int i = 0, next;
+
+	while (i < sql_len) {
+		if (isspace((unsigned char) sql[i])) {
+			i++;
+		} else if ((next = oledb_skip_comment(sql, sql_len, i)) != i) {
+			i = next;
+		} else {
+			break;
+		}
+	}
+	return i;
+}
+
+static BOOL oledb_contains_keyword(const char *sql, int sql_len, const char **keywords, int keyword_count)
+{
+	char quote = 0;
+	int i, j, next;
+
+	if (!sql) {
+		return FALSE;
+	}
+	for (i = 0; i < sql_len; i++) {
+		char c = sql[i];
+		if (quote) {
+			if (c == quote) {
+				quote = 0;
+			}
+		} else if ((next = oledb_skip_comment(sql, sql_len, i)) != i) {
+			/* quotes and keywords inside comments don't count */
+			i = next - 1;
+		} else if (c == '\'' || c == '"') {
+			quote = c;
+		} else if (c == '[') {
+			quote = ']';
+		} else if (isalpha((unsigned char) c) && (i == 0 || !(isalnum((unsigned char) sql[i - 1]) || sql[i - 1] == '_'))) {
+			/* look for the keywords as whole words */
+			for (j = 0; j < keyword_count; j++) {
+				int len = strlen(keywords[j]);
+				if (i + len <= sql_len && _strnicmp(sql + i, keywords[j], len) == 0
+				 && (i + len == sql_len || !(isalnum((unsigned char) sql[i + len]) || sql[i + len] == '_'))) {
+					return TRUE;
+				}
+			}
+		}
+	}
+	return FALSE;
+}
+
+BOOL oledb_is_schema_change(const char *sql, int sql_len)
+{
+	static const char *keywords[] = { "CREATE", "ALTER", "DROP", "SP_RENAME" };
+	return oledb_contains_keyword(sql, sql_len, keywords, sizeof(keywords) / sizeof(keywords[0]));
+}
+
+BOOL oledb_is_data_modification(const char *sql, int sql_len)
+{
+	static const char *keywords[] = { "INSERT", "UPDATE", "DELETE", "MERGE" };
+	int i, j;
+
+	if (!sql) {
+		return FALSE;
+	}
+	/* only the first word matters */
+	i = oledb_skip_to_first_word(sql, sql_len);
+	for (j = 0; j < sizeof(keywords) / sizeof(keywords[0]); j++) {
+		int len = strlen(keywords[j]);
+		if (i + len <= sql_len && _strnicmp(sql + i, keywords[j], len) == 0
+		 && (i + len == sql_len || !(isalnum((unsigned char) sql[i + len]) || sql[i + len] == '_'))) {
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+BOOL oledb_is_plain_select(const char *sql, int sql_len)
+{
+	/* SELECT ... INTO creates a table, and locking hints mean the caller intends to write */
+	static const char *keywords[] = { "INTO", "UPDLOCK", "XLOCK", "HOLDLOCK", "TABLOCKX" };
+	int i;
+
+	if (!sql) {
+		return FALSE;
+	}
+	i = oledb_skip_to_first_word(sql, sql_len);
+	if (i + 6 <= sql_len && _strnicmp(sql + i, "SELECT", 6) == 0
+	 && (i + 6 == sql_len || !(isalnum((unsigned char) sql[i + 6]) || sql[i + 6] == '_'))) {
+		return !oledb_contains_keyword(sql, sql_len, keywords, sizeof(keywords) / sizeof(keywords[0]));
+	}
+	return FALSE;
+}
@@ -28,6 +28,8 @@
 #include "php_pdo_oledb.h"
 #include "php_pdo_oledb_int.h"
 #include "zend_exceptions.h"
+#include "zend_interfaces.h"
+#include "ext/standard/php_smart_str.h"
 
 #define CP_UTF16 1200
 
@@ -35,31 +37,30 @@ static HRESULT oledb_get_codepage(const char *name, int *pCodePage) {
 	HRESULT hr = E_FAIL;
 
 	if (name) {
-		if (pIMultiLanguage) {
-			if (_stricmp(name, "utf8") == 0 || _stricmp(name, "utf-8") == 0) {
-				*pCodePage = CP_UTF8;
-				hr = S_OK;
-			} else if (_stricmp(name, "utf16") == 0 || stricmp(name, "utf-16") == 0) {
-				*pCodePage = CP_UTF16;
-				hr = S_OK;
+		IMultiLanguage *pIMultiLanguage;
+		if (_stricmp(name, "utf8") == 0 || _stricmp(name, "utf-8") == 0) {
+			*pCodePage = CP_UTF8;
+			hr = S_OK;
+		} else if (_stricmp(name, "utf16") == 0 || stricmp(name, "utf-16") == 0) {
+			*pCodePage = CP_UTF16;
+			hr = S_OK;
+		} else if (pIMultiLanguage = oledb_get_multi_language()) {
+			MIMECSETINFO cp_info;
+			LONG len_w = MultiByteToWideChar(CP_ACP, 0, name, -1, NULL, 0);
+			BSTR name_w = SysAllocStringLen(NULL, len_w);
+			MultiByteToWideChar(CP_ACP, 0, name, -1, name_w, len_w);
+			hr = CALL(GetCharsetInfo, pIMultiLanguage, name_w, &cp_info);
+			if (SUCCEEDED(hr)) {
+				*pCodePage = cp_info.uiCodePage;
 			} else {
-				MIMECSETINFO cp_info;
-				LONG len_w = MultiByteToWideChar(CP_ACP, 0, name, -1, NULL, 0);
-				BSTR name_w = SysAllocStringLen(NULL, len_w);
-				MultiByteToWideChar(CP_ACP, 0, name, -1, name_w, len_w);
-				hr = CALL(GetCharsetInfo, pIMultiLanguage, name_w, &cp_info);
-				if (SUCCEEDED(hr)) {
-					*pCodePage = cp_info.uiCodePage;
-				} else {
-					WCHAR buffer[256];
-					if (wcslen(name_w) > 64) name_w[64] = '\0';
-					wcscpy(buffer, L"MLang does not recognize ");
-					wcscat(buffer, name_w);
-					wcscat(buffer, L" as a valid encoding.");
-					oledb_set_automation_error(buffer, L"58004");
-				}
-				SysFreeString(name_w);
+				WCHAR buffer[256];
+				if (wcslen(name_w) > 64) name_w[64] = '\0';
+				wcscpy(buffer, L"MLang does not recognize ");
+				wcscat(buffer, name_w);
+				wcscat(buffer, L" as a valid encoding.");
+				oledb_set_automation_error(buffer, L"58004");
 			}
+			SysFreeString(name_w);
 		}
 	} else {
 		*pCodePage = -1;
@@ -70,17 +71,20 @@ static HRESULT oledb_get_codepage(const char *name, int *pCodePage) {
 
 static HRESULT oledb_create_charset_converter(pdo_oledb_conversion *conv, int type, int fromCodepage, int toCodepage) {
 	HRESULT hr = E_FAIL;
-	if (pIMultiLanguage) {
-		SAFE_RELEASE(conv->pIMLangConvertCharsets[type]);
-		if (fromCodepage != toCodepage && fromCodepage >= 0 && toCodepage >= 0) {
+	SAFE_RELEASE(conv->pIMLangConvertCharsets[type]);
+	if (fromCodepage != toCodepage && fromCodepage >= 0 && toCodepage >= 0) {
+		/* MLang is only started once there's something to convert */
+		IMultiLanguage *pIMultiLanguage = oledb_get_multi_language();
+		conv->pIMLangConvertCharsets[type] = NULL;
+		if (pIMultiLanguage) {
 			hr = CALL(CreateConvertCharset, pIMultiLanguage, fromCodepage, toCodepage, 0, &conv->pIMLangConvertCharsets[type]);
 			if (!SUCCEEDED(hr)) {
 				oledb_set_automation_error(L"MLang cannot create converter for encoding.", L"58004");
 			}
-		} else {
-			conv->pIMLangConvertCharsets[type] = NULL;
-			hr = S_FALSE;
 		}
+	} else {
+		conv->pIMLangConvertCharsets[type] = NULL;
+		hr = S_FALSE;
 	}
 	return hr;
 }
@@ -225,6 +229,7 @@ HRESULT oledb_convert_string(pdo_oledb_conversion *conv, LPCSTR src, UINT lenSrc
 
 UINT oledb_get_proper_truncated_length(LPCSTR s, UINT len, const char *charset) 
 {
+	IMultiLanguage *pIMultiLanguage = oledb_get_multi_language();
 	if (pIMultiLanguage) {
 		int codepage;
 		if (oledb_get_codepage(charset, &codepage) == S_OK) {
@@ -254,6 +259,21 @@ DWORD constant_to_internal_flag(int constant)
 		case PDO_OLEDB_ATTR_USE_ENCRYPTION: return ENCRYPTION;
 		case PDO_OLEDB_ATTR_AUTOTRANSLATE: return AUTOTRANSLATE;
 		case PDO_OLEDB_ATTR_TRUNCATE_STRING: return TRUNCATE_STRING;
+		case PDO_OLEDB_ATTR_PERSISTENT_STATEMENT_CACHE: return PERSISTENT_CACHE;
+		case PDO_OLEDB_ATTR_LAZY_PREPARE: return LAZY_PREPARE;
+		case PDO_ATTR_EMULATE_PREPARES: return EMULATE_PREPARES;
+		case PDO_OLEDB_ATTR_BATCH_EXEC: return BATCH_EXEC;
+		case PDO_OLEDB_ATTR_NO_ROWSET: return NO_ROWSET;
+	}
+	return 0;
+}
+
+static DWORD constant_to_login_flag(long attr)
+{
+	switch (attr) {
+		case PDO_OLEDB_ATTR_RESET_ON_REUSE: return RESET_ON_REUSE;
+		case PDO_OLEDB_ATTR_LAZY_CONNECT: return LAZY_CONNECT;
+		case PDO_OLEDB_ATTR_BULK_TRANSFER: return BULK_TRANSFER;
 	}
 	return 0;
 }
@@ -278,13 +298,154 @@ static int oledb_handle_fetch_error_func(pdo_dbh_t *dbh, pdo_stmt_t *stmt, zval
 	return 1;
 }
 
+static HRESULT oledb_get_pooled_command(pdo_oledb_db_handle *H, ICommandText **ppICommandText)
+{
+	if (H->commandPoolCount > 0) {
+		*ppICommandText = H->pICommandTextPool[--H->commandPoolCount];
+		return S_OK;
+	}
+	return CALL(CreateCommand, H->pIDBCreateCommand, NULL, &IID_ICommandText, (IUnknown **) ppICommandText);
+}
+
+static void oledb_return_pooled_command(pdo_oledb_db_handle *H, ICommandText *pICommandText, HRESULT hr)
+{
+	/* a command that failed might be in an odd state */
+	if (SUCCEEDED(hr) && H->commandPoolCount < PDO_OLEDB_COMMAND_POOL_SIZE) {
+		H->pICommandTextPool[H->commandPoolCount++] = pICommandText;
+	} else {
+		RELEASE(pICommandText);
+	}
+}
+
+static void oledb_release_pooled_commands(pdo_oledb_db_handle *H)
+{
+	while (H->commandPoolCount > 0) {
+		RELEASE(H->pICommandTextPool[--H->commandPoolCount]);
+	}
+}
+
+static void oledb_release_read_session(pdo_oledb_db_handle *H)
+{
+	SAFE_RELEASE(H->pIDBCreateCommandRead);
+	SAFE_RELEASE(H->pIDBPropertiesRead);
+	H->pIDBCreateCommandRead = NULL;
+	H->pIDBPropertiesRead = NULL;
+}
+
+static HRESULT oledb_handle_connect(pdo_dbh_t *dbh TSRMLS_DC)
+{
+	pdo_oledb_db_handle *H = (pdo_oledb_db_handle *)dbh->driver_data;
+	HRESULT hr;
+
+	if (H->pIDBCreateCommand) {
+		return S_OK;
+	}
+
+	/* lazy connect--log in now that the session is needed */
+	hr = H->connect(dbh TSRMLS_CC);
+	if (!SUCCEEDED(hr)) {
+		/* start over next time */
+		SAFE_RELEASE(H->pIDBCreateCommand);
+		oledb_pool_release_data_source(H->pIDBProperties);
+		SAFE_RELEASE(H->pIDBProperties);
+		H->pIDBCreateCommand = NULL;
+		H->pIDBProperties = NULL;
+	}
+	return hr;
+}
+
+static HRESULT oledb_reset_session(pdo_dbh_t *dbh TSRMLS_DC)
+{
+	pdo_oledb_db_handle *H = (pdo_oledb_db_handle *)dbh->driver_data;
+	HRESULT hr;
+	DBPROP prop;
+	DBPROPSET prop_set;
+
+	/* whatever the last user left uncommitted goes */
+	if (H->pITransactionLocal) {
+		CALL(Abort, H->pITransactionLocal, NULL, FALSE, FALSE);
+	}
+	dbh->in_txn = 0;
+	H->batchLen = H->batchCount = 0;
+	H->batchSchemaChange = FALSE;
+
+	/* commands (and any rowsets they still hold) belong to the old session state */
+	oledb_release_pooled_commands(H);
+	if (H->cache) {
+		oledb_release_idle_commands(H->cache);
+	}
+
+	/* the secondary is logged into again when the next user routes a read there */
+	oledb_release_read_session(H);
+	H->readUnavailable = FALSE;
+
+	if (oledb_pool_is_shared_data_source(H->pIDBProperties)) {
+		/* resetting the data source would pull the rug from under other handles (reset on reuse
+		   was turned on after login)--fail so that PDO logs in afresh */
+		oledb_set_automation_error(L"Session shares its data source and cannot be reset", L"08S01");
+		return E_FAIL;
+	}
+
+	/* SET options, temp tables, etc.--the provider resets the connection ahead of the next command */
+	prop.dwPropertyID = DBPROP_RESETDATASOURCE;
+	prop.dwOptions = DBPROPOPTIONS_REQUIRED;
+	prop.colid = DB_NULLID;
+	VariantInit(&prop.vValue);
+	V_VT(&prop.vValue) = VT_I4;
+	V_I4(&prop.vValue) = DBPROPVAL_RD_RESETALL;
+	prop_set.guidPropertySet = DBPROPSET_DATASOURCE;
+	prop_set.cProperties = 1;
+	prop_set.rgProperties = &prop;
+	hr = CALL(SetProperties, H->pIDBProperties, 1, &prop_set);
+	if (hr != S_OK && prop.dwStatus == DBPROPSTATUS_NOTSUPPORTED) {
+		/* provider has nothing to reset */
+		hr = S_OK;
+	}
+	return hr;
+}
+
+static int oledb_handle_check_liveness(pdo_dbh_t *dbh TSRMLS_DC)
+{
+	pdo_oledb_db_handle *H = (pdo_oledb_db_handle *)dbh->driver_data;
+
+	/* called when PDO reuses a persistent handle; failing makes PDO reconnect */
+	if ((H->loginFlags & RESET_ON_REUSE) && H->pIDBCreateCommand) {
+		if (oledb_reset_session(dbh TSRMLS_CC) != S_OK) {
+			return FAILURE;
+		}
+	}
+	return SUCCESS;
+}
+
 static int oledb_handle_closer(pdo_dbh_t *dbh TSRMLS_DC)
 {
 	pdo_oledb_db_handle *H = (pdo_oledb_db_handle *)dbh->driver_data;
 	
 	if (H) {
+		oledb_flush_batch(dbh TSRMLS_CC);
+		if (H->poolKey) {
+			/* a session that can't be reset isn't handed to someone else */
+			BOOL reusable = !(H->loginFlags & RESET_ON_REUSE) || oledb_reset_session(dbh TSRMLS_CC) == S_OK;
+
+			/* commands created on the session have to go before it's handed on */
+			oledb_release_pooled_commands(H);
+			oledb_release_statement_cache(H->cache);
+			H->cache = NULL;
+			if (reusable) {
+				oledb_pool_checkin(H->poolKey, H->pIDBProperties, H->pIDBCreateCommand);
+			} else {
+				oledb_pool_checkin(H->poolKey, NULL, NULL);
+			}
+			efree(H->poolKey);
+		}
+		if (H->batch) {
+			pefree(H->batch, dbh->is_persistent);
+		}
+		oledb_release_pooled_commands(H);
+		oledb_release_read_session(H);
 		SAFE_RELEASE(H->pITransactionLocal);
 		SAFE_RELEASE(H->pIDBCreateCommand);
+		oledb_pool_release_data_source(H->pIDBProperties);
 		SAFE_RELEASE(H->pIDBProperties);
 
 		if (H->einfo.errmsg) {
@@ -293,7 +454,14 @@ static int oledb_handle_closer(pdo_dbh_t *dbh TSRMLS_DC)
 		if (H->appname) {
 			pefree(H->appname, dbh->is_persistent);
 		}
+		if (H->providerKey) {
+			pefree(H->providerKey, dbh->is_persistent);
+		}
+		if (H->readHost) {
+			pefree(H->readHost, dbh->is_persistent);
+		}
 		oledb_release_conversion_options(H->conv);
+		oledb_release_statement_cache(H->cache);
 		pefree(H, dbh->is_persistent);
 		dbh->driver_data = NULL;
 	}
@@ -302,6 +470,32 @@ static int oledb_handle_closer(pdo_dbh_t *dbh TSRMLS_DC)
 
 HRESULT oledb_stmt_set_driver_options(pdo_stmt_t *stmt, zval *driver_options TSRMLS_DC);
 
+static void oledb_probe_columns(pdo_oledb_db_handle *H, pdo_oledb_stmt *S)
+{
+	IColumnsInfo *pIColumnsInfo = NULL;
+	DBORDINAL count;
+	DBCOLUMNINFO *info = NULL;
+	OLECHAR *strings = NULL;
+	int column_count = oledb_get_cached_column_count(H->cache, S->cacheKey, S->cacheKeyLen);
+
+	/* a DML statement returns rows only if it has an OUTPUT clause--ask once per statement text */
+	if (column_count < 0) {
+		QUERY_INTERFACE(S->pICommand, IID_IColumnsInfo, pIColumnsInfo);
+		if (pIColumnsInfo) {
+			if (SUCCEEDED(CALL(GetColumnInfo, pIColumnsInfo, &count, &info, &strings))) {
+				column_count = (int) count;
+				oledb_set_cached_column_count(H->cache, S->cacheKey, S->cacheKeyLen, column_count);
+				CoTaskMemFree(info);
+				CoTaskMemFree(strings);
+			}
+			RELEASE(pIColumnsInfo);
+		}
+	}
+	if (column_count == 0) {
+		S->flags |= NO_ROWSET;
+	}
+}
+
 static int oledb_handle_preparer(pdo_dbh_t *dbh, const char *sql, long sql_len, pdo_stmt_t *stmt, zval *driver_options TSRMLS_DC)
 {
 	pdo_oledb_db_handle *H = (pdo_oledb_db_handle *)dbh->driver_data;
@@ -314,6 +508,7 @@ static int oledb_handle_preparer(pdo_dbh_t *dbh, const char *sql, long sql_len,
 	BSTR sql_w = NULL;
 	char *nsql = NULL;
 	int nsql_len = 0;
+	BOOL cached, reused;
 
 	S->H = H;
 	S->flags = H->flags;
@@ -322,10 +517,38 @@ static int oledb_handle_preparer(pdo_dbh_t *dbh, const char *sql, long sql_len,
 	stmt->driver_data = S;
 	stmt->methods = &oledb_stmt_methods;
 
+	hr = oledb_handle_connect(dbh TSRMLS_CC);
+	if (!SUCCEEDED(hr)) goto cleanup;
+
 	hr = oledb_stmt_set_driver_options(stmt, driver_options TSRMLS_CC);
 	if (!SUCCEEDED(hr)) goto cleanup;
 
-	hr = CALL(CreateCommand, H->pIDBCreateCommand, NULL, &IID_ICommand, (IUnknown **) &S->pICommand);
+	/* commands start out on the primary--execute moves reads made outside a transaction */
+	S->plainSelect = H->readHost && oledb_is_plain_select(sql, sql_len);
+
+	/* commands and parameter info are remembered by the statement text */
+	S->cacheKey = oledb_normalize_statement(sql, sql_len, &S->cacheKeyLen);
+	S->cacheGeneration = H->cache->generation;
+
+	if (S->flags & EMULATE_PREPARES) {
+		/* PDO inlines the parameters through the quoter--the command is run as-is */
+		hr = CALL(CreateCommand, H->pIDBCreateCommand, NULL, &IID_ICommand, (IUnknown **) &S->pICommand);
+		if (!SUCCEEDED(hr)) goto cleanup;
+		stmt->supports_placeholders = PDO_PLACEHOLDER_NONE;
+		ret = 1;
+		goto cleanup;
+	}
+
+	if ((!dbh->is_persistent || (H->flags & PERSISTENT_CACHE)) && S->conv == H->conv && !(S->flags & COMMAND_PROPERTY_FLAGS) && !oledb_is_schema_change(S->cacheKey, S->cacheKeyLen)) {
+		/* the command can be handed to the next statement with the same text */
+		S->flags |= CACHED_COMMAND;
+	}
+	cached = (oledb_find_cached_statement(H->cache, S->cacheKey, S->cacheKeyLen, &S->paramCount, &S->paramInfo, &S->paramNamesBuffer) == S_OK);
+	reused = cached && (S->flags & CACHED_COMMAND) && oledb_checkout_cached_command(H->cache, S, (IUnknown *) H->pIDBCreateCommand);
+
+	if (!reused) {
+		hr = CALL(CreateCommand, H->pIDBCreateCommand, NULL, &IID_ICommand, (IUnknown **) &S->pICommand);
+	}
 
 	/* perform prepare only if provider supports placeholders */
 	QUERY_INTERFACE(S->pICommand, IID_ICommandWithParameters, S->pICommandWithParameters);
@@ -346,6 +569,16 @@ static int oledb_handle_preparer(pdo_dbh_t *dbh, const char *sql, long sql_len,
 			goto cleanup;
 		}
 
+		if (reused) {
+			/* the command is already prepared */
+			if (oledb_is_data_modification(S->cacheKey, S->cacheKeyLen)) {
+				oledb_probe_columns(H, S);
+			}
+			hr = S_OK;
+			ret = 1;
+			goto cleanup;
+		}
+
 		hr = QUERY_INTERFACE(S->pICommand, IID_ICommandText, pICommandText);
 		if (!pICommandText) goto cleanup;
 
@@ -355,22 +588,36 @@ static int oledb_handle_preparer(pdo_dbh_t *dbh, const char *sql, long sql_len,
 		if (!SUCCEEDED(hr)) goto cleanup;
 
 		/* don't do a round-trip to server to prepare statement for PDO::query() */
-		if (!stmt->active_query_string) {
+		if (!stmt->active_query_string && (S->flags & LAZY_PREPARE)) {
+			/* nor for one that might only run once--prepare it when it's executed again */
+			S->flags |= PREPARE_PENDING;
+		} else if (!stmt->active_query_string) {
 			hr = QUERY_INTERFACE(S->pICommand, IID_ICommandPrepare, pICommandPrepare);
 			if (pICommandPrepare) {
 				hr = CALL(Prepare, pICommandPrepare, 0);
 				if (!SUCCEEDED(hr)) goto cleanup;
 
-				if (S->pICommandWithParameters) {
+				if (!cached) {
 					/* see if the provider can derive parameter information */
 					hr = CALL(GetParameterInfo, S->pICommandWithParameters, &S->paramCount, &S->paramInfo, &S->paramNamesBuffer);
+					if (SUCCEEDED(hr) && !oledb_is_schema_change(S->cacheKey, S->cacheKeyLen)) {
+						oledb_add_cached_statement(H->cache, S->cacheKey, S->cacheKeyLen, S->paramCount, S->paramInfo, S->paramNamesBuffer);
+					}
+				}
+				if (oledb_is_data_modification(S->cacheKey, S->cacheKeyLen)) {
+					oledb_probe_columns(H, S);
 				}
 			} else {
+				S->flags &= ~CACHED_COMMAND;
 				hr = S_OK;
 			}
+		} else {
+			/* an unprepared command isn't worth keeping */
+			S->flags &= ~CACHED_COMMAND;
 		}
 		ret = 1;
 	} else {
+		S->flags &= ~CACHED_COMMAND;
 		stmt->supports_placeholders = PDO_PLACEHOLDER_NONE;
 		ret = 1;
 	}
@@ -384,10 +631,91 @@ cleanup:
 	return ret;
 }
 
+static void oledb_queue_batch(pdo_dbh_t *dbh, const char *sql, long sql_len)
+{
+	pdo_oledb_db_handle *H = (pdo_oledb_db_handle *)dbh->driver_data;
+	int needed = H->batchLen + sql_len + 3;
+
+	if (needed > H->batchAlloc) {
+		H->batchAlloc = max(needed, H->batchAlloc * 2);
+		H->batch = perealloc(H->batch, H->batchAlloc, dbh->is_persistent);
+	}
+	memcpy(H->batch + H->batchLen, sql, sql_len);
+	H->batchLen += sql_len;
+	memcpy(H->batch + H->batchLen, ";\n", 3);
+	H->batchLen += 2;
+	H->batchCount++;
+	if (oledb_is_schema_change(sql, sql_len)) {
+		H->batchSchemaChange = TRUE;
+	}
+}
+
+HRESULT oledb_flush_batch(pdo_dbh_t *dbh TSRMLS_DC)
+{
+	pdo_oledb_db_handle *H = (pdo_oledb_db_handle *)dbh->driver_data;
+	HRESULT hr = S_FALSE;
+	ICommandText *pICommandText = NULL;
+	IMultipleResults *pIMultipleResults = NULL;
+	DBROWCOUNT rows_affected;
+	BSTR sql_w = NULL;
+
+	if (!H->batchCount) {
+		return S_FALSE;
+	}
+	H->batchRowsAffected = 0;
+
+	hr = oledb_handle_connect(dbh TSRMLS_CC);
+	if (!SUCCEEDED(hr)) goto cleanup;
+
+	hr = oledb_get_pooled_command(H, &pICommandText);
+	if (!pICommandText) goto cleanup;
+
+	oledb_create_bstr(H->conv, H->batch, H->batchLen, &sql_w, NULL, CONVERT_FROM_INPUT_TO_QUERY);
+
+	/* the queue is gone whether or not it goes through */
+	H->batchLen = 0;
+	H->batchCount = 0;
+
+	hr = CALL(SetCommandText, pICommandText, &DBGUID_DEFAULT, sql_w);
+	if (!SUCCEEDED(hr)) goto cleanup;
+
+	hr = CALL(Execute, (ICommand *) pICommandText, NULL, &IID_IMultipleResults, NULL, NULL, (IUnknown **) &pIMultipleResults);
+	if (hr == E_NOINTERFACE) {
+		/* the provider can't give the counts separately */
+		hr = CALL(Execute, (ICommand *) pICommandText, NULL, &IID_NULL, NULL, &rows_affected, NULL);
+		if (SUCCEEDED(hr) && rows_affected != DB_COUNTUNAVAILABLE) {
+			H->batchRowsAffected = rows_affected;
+		}
+	} else if (pIMultipleResults) {
+		/* collect the count from each statement */
+		do {
+			rows_affected = DB_COUNTUNAVAILABLE;
+			hr = CALL(GetResult, pIMultipleResults, NULL, DBRESULTFLAG_DEFAULT, &IID_NULL, &rows_affected, NULL);
+			if (SUCCEEDED(hr) && hr != DB_S_NORESULT && rows_affected != DB_COUNTUNAVAILABLE) {
+				H->batchRowsAffected += (long) rows_affected;
+			}
+		} while (SUCCEEDED(hr) && hr != DB_S_NORESULT);
+	}
+	if (!SUCCEEDED(hr)) goto cleanup;
+
+	if (H->batchSchemaChange) {
+		oledb_clear_statement_cache(H->cache);
+	}
+
+cleanup:
+	H->batchSchemaChange = FALSE;
+	SAFE_RELEASE(pIMultipleResults);
+	if (pICommandText) {
+		oledb_return_pooled_command(H, pICommandText, hr);
+	}
+	SysFreeString(sql_w);
+	return hr;
+}
+
 static long oledb_handle_doer(pdo_dbh_t *dbh, const char *sql, long sql_len TSRMLS_DC)
 {
 	pdo_oledb_db_handle *H = (pdo_oledb_db_handle *)dbh->driver_data;
-	int ret = -1;
+	long ret = -1;
 
 	HRESULT hr;
 	ICommandText *pICommandText = NULL;
@@ -396,7 +724,21 @@ static long oledb_handle_doer(pdo_dbh_t *dbh, const char *sql, long sql_len TSRM
 	DBCOUNTITEM rows_affected;
 	BSTR sql_w = NULL;
 
-	hr = CALL(CreateCommand, H->pIDBCreateCommand, NULL, &IID_ICommandText, (IUnknown **) &pICommandText);
+	if (H->flags & BATCH_EXEC) {
+		/* queue it up--the count isn't known until the batch is sent */
+		oledb_queue_batch(dbh, sql, sql_len);
+		hr = S_OK;
+		if (H->batchCount >= PDO_OLEDB_BATCH_MAX_STATEMENTS || H->batchLen >= PDO_OLEDB_BATCH_MAX_BYTES) {
+			hr = oledb_flush_batch(dbh TSRMLS_CC);
+		}
+		ret = SUCCEEDED(hr) ? 0 : -1;
+		goto cleanup;
+	}
+
+	hr = oledb_handle_connect(dbh TSRMLS_CC);
+	if (!SUCCEEDED(hr)) goto cleanup;
+
+	hr = oledb_get_pooled_command(H, &pICommandText);
 	if (!pICommandText) goto cleanup;
 
 	oledb_create_bstr(H->conv, sql, -1, &sql_w, NULL, CONVERT_FROM_INPUT_TO_QUERY);
@@ -411,10 +753,17 @@ static long oledb_handle_doer(pdo_dbh_t *dbh, const char *sql, long sql_len TSRM
 	hr = CALL(Execute, pICommand, NULL, &IID_NULL, &params, &rows_affected, NULL);
 	if (!SUCCEEDED(hr)) goto cleanup;
 
-	ret = 0;
+	if (oledb_is_schema_change(sql, sql_len)) {
+		/* cached parameter info might no longer be accurate */
+		oledb_clear_statement_cache(H->cache);
+	}
+
+	ret = (rows_affected == DB_COUNTUNAVAILABLE) ? 0 : (long) rows_affected;
 
 cleanup:
-	SAFE_RELEASE(pICommandText);
+	if (pICommandText) {
+		oledb_return_pooled_command(H, pICommandText, hr);
+	}
 	SAFE_RELEASE(pICommand);
 	SysFreeString(sql_w);
 	pdo_oledb_error(dbh, hr);
@@ -423,7 +772,53 @@ cleanup:
 
 static int oledb_handle_quoter(pdo_dbh_t *dbh, const char *unquoted, int unquotedlen, char **quoted, int *quotedlen, enum pdo_param_type param_type  TSRMLS_DC)
 {
-	return 0;
+	pdo_oledb_db_handle *H = (pdo_oledb_db_handle *)dbh->driver_data;
+	BOOL mssql = (dbh->driver == &pdo_mssql_driver);
+	char *s, *d;
+	int i;
+
+	if (PDO_PARAM_TYPE(param_type) == PDO_PARAM_INT || PDO_PARAM_TYPE(param_type) == PDO_PARAM_BOOL) {
+		long lval;
+		double dval;
+		if (is_numeric_string((char *) unquoted, unquotedlen, &lval, &dval, FALSE)) {
+			/* numbers go in as they are */
+			*quoted = estrndup(unquoted, unquotedlen);
+			*quotedlen = unquotedlen;
+			return 1;
+		}
+	} else if (PDO_PARAM_TYPE(param_type) == PDO_PARAM_LOB && mssql) {
+		/* binary literal */
+		static const char hex[] = "0123456789ABCDEF";
+		*quotedlen = 2 + unquotedlen * 2;
+		*quoted = d = emalloc(*quotedlen + 1);
+		*d++ = '0';
+		*d++ = 'x';
+		for (i = 0; i < unquotedlen; i++) {
+			unsigned char c = (unsigned char) unquoted[i];
+			*d++ = hex[c >> 4];
+			*d++ = hex[c & 0x0F];
+		}
+		*d = '\0';
+		return 1;
+	}
+
+	/* string literal, with embedded quotes doubled */
+	s = d = emalloc(3 + unquotedlen * 2 + 1);
+	if (mssql && (H->flags & STRING_AS_UNICODE)) {
+		*d++ = 'N';
+	}
+	*d++ = '\'';
+	for (i = 0; i < unquotedlen; i++) {
+		if (unquoted[i] == '\'') {
+			*d++ = '\'';
+		}
+		*d++ = unquoted[i];
+	}
+	*d++ = '\'';
+	*d = '\0';
+	*quoted = s;
+	*quotedlen = d - s;
+	return 1;
 }
 
 static int oledb_handle_begin(pdo_dbh_t *dbh TSRMLS_DC)
@@ -431,7 +826,13 @@ static int oledb_handle_begin(pdo_dbh_t *dbh TSRMLS_DC)
 	pdo_oledb_db_handle *H = (pdo_oledb_db_handle *)dbh->driver_data;
 	int ret = 0;
 
-	HRESULT hr = S_FALSE;
+	HRESULT hr = oledb_flush_batch(dbh TSRMLS_CC);
+	if (!SUCCEEDED(hr)) goto cleanup;
+
+	hr = oledb_handle_connect(dbh TSRMLS_CC);
+	if (!SUCCEEDED(hr)) goto cleanup;
+
+	hr = S_FALSE;
 	if (H->pITransactionLocal) {
 		hr = CALL(StartTransaction, H->pITransactionLocal, ISOLATIONLEVEL_ISOLATED, 0, NULL, NULL);
 		if (!SUCCEEDED(hr)) goto cleanup;
@@ -449,7 +850,10 @@ static int oledb_handle_commit(pdo_dbh_t *dbh TSRMLS_DC)
 	pdo_oledb_db_handle *H = (pdo_oledb_db_handle *)dbh->driver_data;
 	int ret = 0;
 
-	HRESULT hr = S_FALSE;
+	HRESULT hr = oledb_flush_batch(dbh TSRMLS_CC);
+	if (!SUCCEEDED(hr)) goto cleanup;
+
+	hr = S_FALSE;
 	if (H->pITransactionLocal) {
 		hr = CALL(Commit, H->pITransactionLocal, FALSE, XACTTC_SYNC, 0);
 		if (!SUCCEEDED(hr)) goto cleanup;
@@ -468,6 +872,12 @@ static int oledb_handle_rollback(pdo_dbh_t *dbh TSRMLS_DC)
 	int ret = 0;
 
 	HRESULT hr = S_FALSE;
+
+	/* statements queued inside the transaction would have been undone anyway */
+	H->batchLen = 0;
+	H->batchCount = 0;
+	H->batchSchemaChange = FALSE;
+
 	if (H->pITransactionLocal) {
 		hr = CALL(Abort, H->pITransactionLocal, NULL, FALSE, FALSE);
 		if (!SUCCEEDED(hr)) goto cleanup;
@@ -502,7 +912,13 @@ static char *oledb_handle_last_insert_id(pdo_dbh_t *dbh, const char *name, unsig
 		char value[128];
 	} buffer;
 
-	hr = CALL(CreateCommand, H->pIDBCreateCommand, NULL, &IID_ICommandText, (IUnknown **) &pICommandText);
+	hr = oledb_flush_batch(dbh TSRMLS_CC);
+	if (!SUCCEEDED(hr)) goto cleanup;
+
+	hr = oledb_handle_connect(dbh TSRMLS_CC);
+	if (!SUCCEEDED(hr)) goto cleanup;
+
+	hr = oledb_get_pooled_command(H, &pICommandText);
 	if (!pICommandText) goto cleanup;
 
 	hr = CALL(SetCommandText, pICommandText, &DBGUID_DEFAULT, L"SELECT @@IDENTITY");
@@ -545,15 +961,18 @@ static char *oledb_handle_last_insert_id(pdo_dbh_t *dbh, const char *name, unsig
 	}
 
 cleanup:
-	SAFE_RELEASE(pICommandText);
-	SAFE_RELEASE(pICommand);
-	SAFE_RELEASE(pIRowset);
 	if (pIAccessor) {
 		if (hAccessor) {
 			CALL(ReleaseAccessor, pIAccessor, hAccessor, NULL);
 		}
 		RELEASE(pIAccessor);
 	}
+	/* the rowset has to go before the command can be used again */
+	SAFE_RELEASE(pIRowset);
+	SAFE_RELEASE(pICommand);
+	if (pICommandText) {
+		oledb_return_pooled_command(H, pICommandText, hr);
+	}
 	pdo_oledb_error(dbh, hr);
 	return ret;
 }
@@ -804,11 +1223,55 @@ static HRESULT oledb_set_driver_option(pdo_dbh_t *dbh, long attr, zval *val TSRM
 			H->appname = pestrdup(Z_STRVAL_P(val), dbh->is_persistent);
 			hr = S_OK;
 			break;
+		case PDO_OLEDB_ATTR_STATEMENT_CACHE_SIZE:
+			convert_to_long(val);
+			oledb_resize_statement_cache(H->cache, Z_LVAL_P(val));
+			hr = S_OK;
+			break;
+		case PDO_OLEDB_ATTR_PACKET_SIZE:
+			/* takes effect on login */
+			convert_to_long(val);
+			if (Z_LVAL_P(val) == PDO_OLEDB_PACKET_SIZE_AUTO || Z_LVAL_P(val) == 0
+			|| (Z_LVAL_P(val) >= PDO_OLEDB_PACKET_SIZE_MIN && Z_LVAL_P(val) <= PDO_OLEDB_PACKET_SIZE_MAX)) {
+				H->packetSize = Z_LVAL_P(val);
+				hr = S_OK;
+			} else {
+				oledb_set_automation_error(L"Packet size must be between 512 and 32767 bytes", L"HY024");
+				hr = E_FAIL;
+			}
+			break;
+		case PDO_OLEDB_ATTR_RESET_ON_REUSE:
+		case PDO_OLEDB_ATTR_LAZY_CONNECT:
+		case PDO_OLEDB_ATTR_BULK_TRANSFER:
+			convert_to_boolean(val);
+			if (Z_BVAL_P(val)) {
+				H->loginFlags |= constant_to_login_flag(attr);
+			} else {
+				H->loginFlags &= ~constant_to_login_flag(attr);
+			}
+			hr = S_OK;
+			break;
+		case PDO_OLEDB_ATTR_ROUTE_SELECTS:
+			/* only matters when the DSN names a readhost */
+			convert_to_boolean(val);
+			H->routeSelects = Z_BVAL_P(val);
+			hr = S_OK;
+			break;
 		default:
 			hr = oledb_set_conversion_option(&H->conv, attr, val, TRUE TSRMLS_CC);
-			if (hr == S_FALSE) {
-				DWORD mask = SECURE_CONNECTION | CONNECTION_POOLING | ENCRYPTION | AUTOTRANSLATE | STRING_AS_UNICODE | STRING_AS_LOB | TRUNCATE_STRING | UNIQUE_ROWS | ADD_TABLE_NAME | ADD_CATALOG_NAME | CONVERT_DATE_TIME | SCROLLABLE_CURSOR | SERVER_SIDE_CURSOR;
+			if (hr == S_OK) {
+				/* cached commands were set up with the old query encoding */
+				oledb_clear_statement_cache(H->cache);
+			} else if (hr == S_FALSE) {
+				DWORD mask = SECURE_CONNECTION | CONNECTION_POOLING | ENCRYPTION | AUTOTRANSLATE | PERSISTENT_CACHE | LAZY_PREPARE | EMULATE_PREPARES | BATCH_EXEC | STRING_AS_UNICODE | STRING_AS_LOB | TRUNCATE_STRING | UNIQUE_ROWS | ADD_TABLE_NAME | ADD_CATALOG_NAME | CONVERT_DATE_TIME | SCROLLABLE_CURSOR | SERVER_SIDE_CURSOR;
 				hr = oledb_set_internal_flag(attr, val, mask, &H->flags);
+				if (hr == S_OK && attr == PDO_OLEDB_ATTR_BATCH_EXEC && !(H->flags & BATCH_EXEC)) {
+					hr = oledb_flush_batch(dbh TSRMLS_CC);
+				}
+				if (hr == S_OK && attr == PDO_OLEDB_ATTR_PERSISTENT_STATEMENT_CACHE && dbh->is_persistent && !(H->flags & PERSISTENT_CACHE)) {
+					/* don't hold on to commands between requests unless asked to */
+					oledb_release_idle_commands(H->cache);
+				}
 			}
 	}
 	return hr;
@@ -881,9 +1344,63 @@ static int oledb_get_property(pdo_oledb_db_handle *H, const GUID *prop_set_id, D
 	return success;
 }
 
+static int oledb_get_cached_property(pdo_oledb_db_handle *H, const GUID *prop_set_id, DBPROPID prop_id, VARIANT *pVar) 
+{
+	VARIANT var;
+	BOOL supported;
+
+	/* capabilities don't change from one connection to the next */
+	if (H->providerKey && oledb_pool_get_property(H->providerKey, prop_set_id, prop_id, &supported, pVar)) {
+		return supported;
+	}
+	VariantInit(&var);
+	supported = oledb_get_property(H, prop_set_id, prop_id, &var);
+	if (H->providerKey) {
+		oledb_pool_set_property(H->providerKey, prop_set_id, prop_id, supported, &var);
+	}
+	if (pVar) {
+		*pVar = var;
+	} else {
+		VariantClear(&var);
+	}
+	return supported;
+}
+
 static int oledb_get_data_source_property(pdo_oledb_db_handle *H, DBPROPID prop_id, VARIANT *pVar) 
 {
-	return oledb_get_property(H, &DBPROPSET_DATASOURCEINFO, prop_id, pVar);
+	return oledb_get_cached_property(H, &DBPROPSET_DATASOURCEINFO, prop_id, pVar);
+}
+
+static void oledb_set_provider_key(pdo_dbh_t *dbh)
+{
+	pdo_oledb_db_handle *H = (pdo_oledb_db_handle *)dbh->driver_data;
+	IPersist *pIPersist = NULL;
+	CLSID clsid;
+
+	if (H->providerKey) {
+		return;
+	}
+
+	/* the capability cache is keyed by provider and data source */
+	QUERY_INTERFACE(H->pIDBProperties, IID_IPersist, pIPersist);
+	if (pIPersist) {
+		if (SUCCEEDED(CALL(GetClassID, pIPersist, &clsid))) {
+			WCHAR clsid_w[40];
+			char clsid_a[40];
+			char *key;
+
+			StringFromGUID2(&clsid, clsid_w, sizeof(clsid_w) / sizeof(clsid_w[0]));
+			WideCharToMultiByte(CP_ACP, 0, clsid_w, -1, clsid_a, sizeof(clsid_a), NULL, NULL);
+			spprintf(&key, 0, "%s|%s", clsid_a, dbh->data_source);
+			if (dbh->is_persistent) {
+				H->providerKey = pestrdup(key, 1);
+				efree(key);
+			} else {
+				H->providerKey = key;
+			}
+		}
+		RELEASE(pIPersist);
+	}
 }
 
 static char *oledb_get_version_info(pdo_oledb_db_handle *H, DBPROPID name_id, DBPROPID ver_id)
@@ -928,6 +1445,25 @@ static int oledb_handle_get_attr(pdo_dbh_t *dbh, long attr, zval *val TSRMLS_DC)
 	char *str;
 	HRESULT hr;
 
+	switch (attr) {
+		case PDO_ATTR_SERVER_VERSION:	  
+		case PDO_ATTR_CLIENT_VERSION:
+		/* settings the init-string or the server can override at login */
+		case PDO_ATTR_TIMEOUT:
+		case PDO_OLEDB_ATTR_PACKET_SIZE:
+		case PDO_OLEDB_ATTR_APPLICATION_NAME:
+		case PDO_OLEDB_ATTR_USE_INTEGRATED_AUTHENTICATION:
+		case PDO_OLEDB_ATTR_USE_CONNECTION_POOLING:
+		case PDO_OLEDB_ATTR_USE_ENCRYPTION:
+		case PDO_OLEDB_ATTR_AUTOTRANSLATE:
+			hr = oledb_handle_connect(dbh TSRMLS_CC);
+			if (!SUCCEEDED(hr)) {
+				pdo_oledb_error(dbh, hr);
+				return 0;
+			}
+			break;
+	}
+
 	switch (attr) {
 		case PDO_ATTR_SERVER_VERSION:	  
 			if (str = oledb_get_version_info(H, DBPROP_DBMSNAME, DBPROP_DBMSVER)) {
@@ -941,12 +1477,41 @@ static int oledb_handle_get_attr(pdo_dbh_t *dbh, long attr, zval *val TSRMLS_DC)
 				hr = S_OK;
 			} 
 			break;
+		case PDO_OLEDB_ATTR_STATEMENT_CACHE_SIZE:
+			ZVAL_LONG(val, H->cache->size);
+			hr = S_OK;
+			break;
+		case PDO_OLEDB_ATTR_STATEMENT_CACHE_STATS:
+			oledb_get_statement_cache_stats(H->cache, val);
+			hr = S_OK;
+			break;
+		case PDO_OLEDB_ATTR_BATCH_ROW_COUNT:
+			ZVAL_LONG(val, H->batchRowsAffected);
+			hr = S_OK;
+			break;
+		case PDO_OLEDB_ATTR_PACKET_SIZE:
+			/* what the server agreed to, once connected */
+			ZVAL_LONG(val, H->negotiatedPacketSize ? H->negotiatedPacketSize : H->packetSize);
+			hr = S_OK;
+			break;
+		case PDO_OLEDB_ATTR_RESET_ON_REUSE:
+		case PDO_OLEDB_ATTR_LAZY_CONNECT:
+		case PDO_OLEDB_ATTR_BULK_TRANSFER:
+			ZVAL_BOOL(val, (H->loginFlags & constant_to_login_flag(attr)) ? TRUE : FALSE);
+			hr = S_OK;
+			break;
+		case PDO_OLEDB_ATTR_ROUTE_SELECTS:
+			ZVAL_BOOL(val, H->routeSelects);
+			hr = S_OK;
+			break;
 		case PDO_ATTR_TIMEOUT:
 			ZVAL_LONG(val, H->timeout);
 			hr = S_OK;
+			break;
 		case PDO_OLEDB_ATTR_APPLICATION_NAME:
-			ZVAL_STRING(val, H->appname, TRUE);
+			ZVAL_STRING(val, SAFE_STRING(H->appname), TRUE);
 			hr = S_OK;
+			break;
 		default:
 			hr = oledb_get_conversion_option(H->conv, attr, val TSRMLS_CC);
 			if (hr == S_FALSE) {
@@ -956,6 +1521,253 @@ static int oledb_handle_get_attr(pdo_dbh_t *dbh, long attr, zval *val TSRMLS_DC)
 	return SUCCEEDED(hr);
 }
 
+static int oledb_add_batch_query(smart_str *sql, zval *params, zval *query TSRMLS_DC)
+{
+	HashTable *values = NULL;
+	zval **z;
+	char *s, quote = 0;
+	int len, i;
+
+	if (Z_TYPE_P(query) == IS_ARRAY) {
+		/* array(sql, params) */
+		zval **q, **p;
+		if (zend_hash_index_find(Z_ARRVAL_P(query), 0, (void **) &q) == FAILURE || Z_TYPE_PP(q) != IS_STRING) {
+			return FAILURE;
+		}
+		if (zend_hash_index_find(Z_ARRVAL_P(query), 1, (void **) &p) == SUCCESS && Z_TYPE_PP(p) == IS_ARRAY) {
+			values = Z_ARRVAL_PP(p);
+			zend_hash_internal_pointer_reset(values);
+		}
+		query = *q;
+	} else if (Z_TYPE_P(query) != IS_STRING) {
+		return FAILURE;
+	}
+	s = Z_STRVAL_P(query);
+	len = Z_STRLEN_P(query);
+
+	/* turn every placeholder into a positional one, collecting the values in the same order */
+	for (i = 0; i < len; i++) {
+		char c = s[i];
+		if (quote) {
+			if (c == quote) {
+				quote = 0;
+			}
+		} else if (c == '\'' || c == '"') {
+			quote = c;
+		} else if (c == '[') {
+			quote = ']';
+		} else if (c == '-' && i + 1 < len && s[i + 1] == '-') {
+			/* comments are dropped--PDO parses the batch again and doesn't know about them */
+			while (i + 1 < len && s[i + 1] != '\n') {
+				i++;
+			}
+			c = ' ';
+		} else if (c == '/' && i + 1 < len && s[i + 1] == '*') {
+			for (i += 2; i + 1 < len && !(s[i] == '*' && s[i + 1] == '/'); i++);
+			i = min(i + 1, len);
+			c = ' ';
+		} else if (c == ':' && i + 1 < len && s[i + 1] == ':') {
+			/* scope resolution, e.g. geography::Point */
+			while (i + 1 < len && s[i + 1] == ':') {
+				smart_str_appendc(sql, c);
+				i++;
+			}
+		} else if (c == '?') {
+			if (!values || zend_hash_get_current_data(values, (void **) &z) == FAILURE) {
+				/* PDO would take it for one of the batch's own placeholders */
+				return FAILURE;
+			}
+			zend_hash_move_forward(values);
+			zval_add_ref(z);
+			add_next_index_zval(params, *z);
+		} else if (c == ':' && i + 1 < len && (isalnum((unsigned char) s[i + 1]) || s[i + 1] == '_')) {
+			int end = i + 1;
+			char *name;
+
+			if (!values) {
+				return FAILURE;
+			}
+			while (end < len && (isalnum((unsigned char) s[end]) || s[end] == '_')) {
+				end++;
+			}
+			/* the value can be keyed with or without the colon */
+			name = estrndup(s + i, end - i);
+			if (zend_hash_find(values, name, end - i + 1, (void **) &z) == FAILURE
+			 && zend_hash_find(values, name + 1, end - i, (void **) &z) == FAILURE) {
+				efree(name);
+				return FAILURE;
+			}
+			efree(name);
+			zval_add_ref(z);
+			add_next_index_zval(params, *z);
+			smart_str_appendc(sql, '?');
+			i = end - 1;
+			continue;
+		}
+		smart_str_appendc(sql, c);
+	}
+	smart_str_appendl(sql, ";\n", 2);
+	return SUCCESS;
+}
+
+/* {{{ proto array PDO::oledbQueryBatch(array $queries [, int $fetch_style])
+   Runs several queries as one command and returns the rows of each result set */
+static void oledb_add_batch_result(zval *result, HashTable *queries, zval *value)
+{
+	char *str_key;
+	uint str_key_len;
+	ulong num_key;
+
+	/* results keep the keys of the queries they came from */
+	switch (zend_hash_get_current_key_ex(queries, &str_key, &str_key_len, &num_key, FALSE, NULL)) {
+		case HASH_KEY_IS_STRING:
+			add_assoc_zval_ex(result, str_key, str_key_len, value);
+			break;
+		case HASH_KEY_IS_LONG:
+			add_index_zval(result, num_key, value);
+			break;
+		default:
+			/* more results than queries--a procedure returned several rowsets */
+			add_next_index_zval(result, value);
+	}
+	zend_hash_move_forward(queries);
+}
+
+static PHP_METHOD(PDO, oledbQueryBatch)
+{
+	zval *object = getThis();
+	pdo_dbh_t *dbh = (pdo_dbh_t *)zend_object_store_get_object(object TSRMLS_CC);
+	pdo_oledb_db_handle *H = (pdo_oledb_db_handle *)dbh->driver_data;
+	zval *queries, **query, *params = NULL, *sql_zv = NULL, *style = NULL;
+	zval *stmt = NULL, *retval = NULL, *rows = NULL;
+	pdo_stmt_t *pstmt;
+	long fetch_style = PDO_FETCH_ASSOC;
+	smart_str sql = {0};
+	HRESULT hr;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "a|l", &queries, &fetch_style) == FAILURE) {
+		RETURN_FALSE;
+	}
+	/* the provider's capabilities are only known after login */
+	hr = oledb_handle_connect(dbh TSRMLS_CC);
+	if (!SUCCEEDED(hr)) {
+		pdo_oledb_error(dbh, hr);
+		RETURN_FALSE;
+	}
+	if (!(H->flags & MULTIPLE_RESULTS)) {
+		_pdo_raise_impl_error(dbh, NULL, "IM001", "provider cannot return multiple results" TSRMLS_CC);
+		RETURN_FALSE;
+	}
+
+	MAKE_STD_ZVAL(params);
+	array_init(params);
+	zend_hash_internal_pointer_reset(Z_ARRVAL_P(queries));
+	while (zend_hash_get_current_data(Z_ARRVAL_P(queries), (void **) &query) == SUCCESS) {
+		if (oledb_add_batch_query(&sql, params, *query TSRMLS_CC) == FAILURE) {
+			_pdo_raise_impl_error(dbh, NULL, "HY093", "invalid query or missing parameter in batch" TSRMLS_CC);
+			smart_str_free(&sql);
+			RETVAL_FALSE;
+			goto cleanup;
+		}
+		zend_hash_move_forward(Z_ARRVAL_P(queries));
+	}
+	array_init(return_value);
+	if (!sql.len) {
+		goto cleanup;
+	}
+	smart_str_0(&sql);
+	MAKE_STD_ZVAL(sql_zv);
+	ZVAL_STRINGL(sql_zv, sql.c, sql.len, 0);
+
+	/* PDO does the parameter binding */
+	zend_call_method_with_1_params(&object, Z_OBJCE_P(object), NULL, "prepare", &stmt, sql_zv);
+	if (!stmt || Z_TYPE_P(stmt) != IS_OBJECT) goto failure;
+
+	/* stop at row counts too, so that each statement yields a result */
+	pstmt = (pdo_stmt_t *) zend_object_store_get_object(stmt TSRMLS_CC);
+	((pdo_oledb_stmt *) pstmt->driver_data)->flags |= COUNT_RESULTS;
+
+	zend_call_method_with_1_params(&stmt, Z_OBJCE_P(stmt), NULL, "execute", &retval, params);
+	if (!retval || !zend_is_true(retval)) goto failure;
+
+	MAKE_STD_ZVAL(style);
+	ZVAL_LONG(style, fetch_style);
+	zend_hash_internal_pointer_reset(Z_ARRVAL_P(queries));
+	do {
+		zval_ptr_dtor(&retval);
+		retval = NULL;
+		if (pstmt->column_count) {
+			zend_call_method_with_1_params(&stmt, Z_OBJCE_P(stmt), NULL, "fetchall", &rows, style);
+			if (!rows || Z_TYPE_P(rows) != IS_ARRAY) goto failure;
+		} else {
+			/* the number of rows affected, or an empty set when the provider didn't say */
+			MAKE_STD_ZVAL(rows);
+			if (pstmt->row_count >= 0) {
+				ZVAL_LONG(rows, pstmt->row_count);
+			} else {
+				array_init(rows);
+			}
+		}
+		oledb_add_batch_result(return_value, Z_ARRVAL_P(queries), rows);
+		rows = NULL;
+		zend_call_method_with_0_params(&stmt, Z_OBJCE_P(stmt), NULL, "nextrowset", &retval);
+	} while (retval && zend_is_true(retval));
+
+	/* statements that produced nothing at all (SET, DECLARE) */
+	while (zend_hash_get_current_data(Z_ARRVAL_P(queries), (void **) &query) == SUCCESS) {
+		MAKE_STD_ZVAL(rows);
+		array_init(rows);
+		oledb_add_batch_result(return_value, Z_ARRVAL_P(queries), rows);
+		rows = NULL;
+	}
+	goto cleanup;
+
+failure:
+	zval_dtor(return_value);
+	RETVAL_FALSE;
+
+cleanup:
+	if (rows) {
+		zval_ptr_dtor(&rows);
+	}
+	if (retval) {
+		zval_ptr_dtor(&retval);
+	}
+	if (stmt) {
+		zval_ptr_dtor(&stmt);
+	}
+	if (style) {
+		zval_ptr_dtor(&style);
+	}
+	if (sql_zv) {
+		zval_ptr_dtor(&sql_zv);
+	}
+	zval_ptr_dtor(&params);
+}
+/* }}} */
+
+static zend_function_entry oledb_dbh_driver_methods[] = {
+	PHP_ME(PDO, oledbQueryBatch, NULL, ZEND_ACC_PUBLIC)
+	{NULL, NULL, NULL}
+};
+
+static zend_function_entry *oledb_handle_get_driver_methods(pdo_dbh_t *dbh, int kind TSRMLS_DC)
+{
+	switch (kind) {
+		case PDO_DBH_DRIVER_METHOD_KIND_DBH:
+			return oledb_dbh_driver_methods;
+		case PDO_DBH_DRIVER_METHOD_KIND_STMT:
+			return oledb_stmt_driver_methods;
+	}
+	return NULL;
+}
+
+static void oledb_handle_persistent_shutdown(pdo_dbh_t *dbh TSRMLS_DC)
+{
+	/* don't let queued statements wait for the next request--there's no one left to report errors to */
+	oledb_flush_batch(dbh TSRMLS_CC);
+}
+
 static struct pdo_dbh_methods oledb_methods = {
 	oledb_handle_closer,
 	oledb_handle_preparer,
@@ -968,7 +1780,9 @@ static struct pdo_dbh_methods oledb_methods = {
 	oledb_handle_last_insert_id,
 	oledb_handle_fetch_error_func,
 	oledb_handle_get_attr,
-	NULL,	/* check_liveness */
+	oledb_handle_check_liveness,
+	oledb_handle_get_driver_methods,
+	oledb_handle_persistent_shutdown,
 };
 
 static void oledb_add_prop_int(DBPROPSET *prop_set, DBPROPID prop_id, int n, int required)
@@ -1019,20 +1833,33 @@ static void oledb_free_prop_strings(DBPROPSET *prop_set)
 
 /* }}} */
 
+static void oledb_get_connection_info(pdo_dbh_t *dbh TSRMLS_DC)
+{
+	pdo_oledb_db_handle *H = (pdo_oledb_db_handle *)dbh->driver_data;
+	VARIANT var;
+
+	/* the server can grant less than what was asked for */
+	VariantInit(&var);
+	if (oledb_get_property(H, &DBPROPSET_SQLSERVERDBINIT, SSPROP_INIT_PACKETSIZE, &var) && V_VT(&var) == VT_I4) {
+		H->negotiatedPacketSize = V_I4(&var);
+	}
+	VariantClear(&var);
+}
+
 static void oledb_check_provider_capability(pdo_dbh_t *dbh TSRMLS_DC)
 {
 	pdo_oledb_db_handle *H = (pdo_oledb_db_handle *)dbh->driver_data;
 	VARIANT var;
 
 	/* See if data source supports returning multiple result-sets */
-	if (oledb_get_property(H, &DBPROPSET_DATASOURCEINFO, DBPROP_MULTIPLERESULTS, &var)) {
+	if (oledb_get_cached_property(H, &DBPROPSET_DATASOURCEINFO, DBPROP_MULTIPLERESULTS, &var)) {
 		if (V_I4(&var) == DBPROPVAL_MR_SUPPORTED) {
-			H->flags = MULTIPLE_RESULTS;
+			H->flags |= MULTIPLE_RESULTS;
 		}
 	}
 }
 
-static HRESULT oledb_set_initialization_properties(pdo_dbh_t *dbh, const char *host, const char *dbname TSRMLS_DC) /* {{{ */
+static HRESULT oledb_set_initialization_properties(pdo_dbh_t *dbh, IDBProperties *pIDBProperties, const char *host, const char *dbname, BOOL read_only TSRMLS_DC) /* {{{ */
 {
 	pdo_oledb_db_handle *H = (pdo_oledb_db_handle *)dbh->driver_data;
 	int i, j;
@@ -1080,7 +1907,7 @@ static HRESULT oledb_set_initialization_properties(pdo_dbh_t *dbh, const char *h
 	}
 
 	/* SQL Server specific */
-	if (oledb_get_property(H, &DBPROPSET_SQLSERVERDBINIT, SSPROP_INIT_APPNAME, NULL)) {
+	if (oledb_get_cached_property(H, &DBPROPSET_SQLSERVERDBINIT, SSPROP_INIT_APPNAME, NULL)) {
 		prop_sets[prop_set_count].rgProperties = props1;
 		prop_sets[prop_set_count].cProperties = 0;
 		prop_sets[prop_set_count].guidPropertySet = DBPROPSET_SQLSERVERDBINIT;
@@ -1093,13 +1920,24 @@ static HRESULT oledb_set_initialization_properties(pdo_dbh_t *dbh, const char *h
 		if (!(H->flags & AUTOTRANSLATE)) {
 			oledb_add_prop_bool(&prop_sets[prop_set_count], SSPROP_INIT_AUTOTRANSLATE, VARIANT_FALSE, 0);
 		}
+		if (H->packetSize == PDO_OLEDB_PACKET_SIZE_AUTO) {
+			if (H->loginFlags & BULK_TRANSFER) {
+				oledb_add_prop_int(&prop_sets[prop_set_count], SSPROP_INIT_PACKETSIZE, PDO_OLEDB_BULK_PACKET_SIZE, 0);
+			}
+		} else if (H->packetSize > 0) {
+			oledb_add_prop_int(&prop_sets[prop_set_count], SSPROP_INIT_PACKETSIZE, H->packetSize, 0);
+		}
+		if (read_only) {
+			/* lets an availability group listener send the login to a readable secondary */
+			oledb_add_prop_string(&prop_sets[prop_set_count], SSPROP_INIT_APPLICATIONINTENT, SysAllocString(L"ReadOnly"), 0);
+		}
 		if (prop_sets[prop_set_count].cProperties > 0) {
 			prop_set_count++;
 		}
 	}
 
 	if (prop_set_count > 0) {
-		hr = CALL(SetProperties, H->pIDBProperties, prop_set_count, prop_sets);
+		hr = CALL(SetProperties, pIDBProperties, prop_set_count, prop_sets);
 		for (i = 0; i < prop_set_count; i++) {
 			oledb_free_prop_strings(&prop_sets[i]);
 		}
@@ -1122,78 +1960,202 @@ cleanup:
 	return hr;
 }
 
-static int oledb_handle_factory_mssql(pdo_dbh_t *dbh, zval *driver_options TSRMLS_DC) /* {{{ */
+static HRESULT oledb_get_mssql_provider(const char *name, CLSID *pClsid)
 {
-	pdo_oledb_db_handle *H;
+	HRESULT hr = S_OK;
+
+	/* SQLOLEDB unless the DSN names another one, e.g. SQLNCLI11 or MSOLEDBSQL (which know about ApplicationIntent) */
+	if (name) {
+		LONG len_w = MultiByteToWideChar(CP_ACP, 0, name, -1, NULL, 0);
+		BSTR name_w = SysAllocStringLen(NULL, len_w);
+		MultiByteToWideChar(CP_ACP, 0, name, -1, name_w, len_w);
+		hr = CLSIDFromProgID(name_w, pClsid);
+		SysFreeString(name_w);
+		if (!SUCCEEDED(hr)) {
+			oledb_set_automation_error(L"Provider is not registered", L"IM002");
+		}
+	} else {
+		*pClsid = CLSID_SQLOLEDB;
+	}
+	return hr;
+}
+
+static HRESULT oledb_connect_mssql(pdo_dbh_t *dbh TSRMLS_DC)
+{
+	pdo_oledb_db_handle *H = (pdo_oledb_db_handle *)dbh->driver_data;
 
-	const char *charset = NULL;
 	const char *dbname = NULL;
 	const char *host = NULL;
 
 	struct pdo_data_src_parser vars[] = {
 		{ "host",		"localhost",	0 },
 		{ "dbname",		NULL,			0 },
+		{ "readhost",	NULL,			0 },
+		{ "provider",	NULL,			0 },
 	};
 
 	int i;
 
-	HRESULT hr;
+	HRESULT hr = S_OK;
+	IDataInitialize *pIDataInitialize;
 	IDBInitialize *pIDBInitialize = NULL;
 	IDBCreateSession *pIDBCreateSession = NULL;
-
-	H = pecalloc(1, sizeof(*H), dbh->is_persistent);
-	dbh->driver_data = H;
-	H->flags = CONVERT_DATE_TIME;
-	H->timeout = 30;
-	oledb_create_conversion_options(&H->conv, dbh->is_persistent);
-
-	hr = oledb_set_driver_options(dbh, driver_options TSRMLS_CC);
-	if (!SUCCEEDED(hr)) goto cleanup;
+	char *pool_key = NULL;
+	BOOL pooled = FALSE, share;
+	CLSID clsid;
 
 	_php_pdo_parse_data_source(dbh->data_source, dbh->data_source_len, vars, sizeof(vars) / sizeof(vars[0]));
 	host = vars[0].optval;
 	dbname = vars[1].optval;
+	if (vars[2].optval && !H->readHost) {
+		H->readHost = pestrdup(vars[2].optval, dbh->is_persistent);
+	}
+	hr = oledb_get_mssql_provider(vars[3].optval, &clsid);
+	if (!SUCCEEDED(hr)) goto cleanup;
+
+	pool_key = oledb_pool_make_key(dbh, "mssql");
+
+	/* persistent handles are kept by PDO already */
+	if (!dbh->is_persistent) {
+		char *label;
+		spprintf(&label, 0, "mssql:%s", dbh->data_source);
+		pooled = oledb_pool_checkout(pool_key, label, &H->pIDBProperties, &H->pIDBCreateCommand);
+		efree(label);
+	}
+
+	if (!pooled) {
+		/* another handle might have logged in with the same settings already--a session
+		   that gets reset (pooled or reset on reuse) does so through its data source, so it
+		   gets one of its own */
+		share = (dbh->is_persistent || !oledb_pool_is_enabled()) && !(H->loginFlags & RESET_ON_REUSE);
+		if (share) {
+			H->pIDBProperties = oledb_pool_get_data_source(pool_key);
+		}
+		if (!H->pIDBProperties) {
+			/* Create the data source object. */
+			if (pIDataInitialize = oledb_get_data_initialize()) {
+				/* use MDAC */
+				hr = CALL(CreateDBInstance, pIDataInitialize, &clsid, NULL, CLSCTX_INPROC_SERVER, NULL,
+										&IID_IDBInitialize, (IUnknown **) &pIDBInitialize);
+			} else {
+				/* otherwise create the object directly */
+				hr = CoCreateInstance(&clsid, NULL, CLSCTX_INPROC_SERVER,
+										&IID_IDBInitialize, (void**) &pIDBInitialize);
+			}
+			if (!pIDBInitialize) goto cleanup;
+
+			/* Get an IDBProperties pointer */
+			hr = QUERY_INTERFACE(pIDBInitialize, IID_IDBProperties, H->pIDBProperties);
+			if (!H->pIDBProperties) goto cleanup;
+
+			/* Set initialization properties */
+			oledb_set_provider_key(dbh);
+			oledb_set_initialization_properties(dbh, H->pIDBProperties, host, dbname, FALSE TSRMLS_CC);
+
+			/* Connect to the database */
+			hr = CALL(Initialize, pIDBInitialize);
+			if (!SUCCEEDED(hr)) goto cleanup;
+
+			if (share) {
+				oledb_pool_add_data_source(pool_key, H->pIDBProperties);
+			}
+		}
 
-	/* Create the data source object. */
-	if (pIDataInitialize) {
-		/* use MDAC */
-		hr = CALL(CreateDBInstance, pIDataInitialize, &CLSID_SQLOLEDB, NULL, CLSCTX_INPROC_SERVER, NULL,
+		/* Create a session */
+		hr = QUERY_INTERFACE(H->pIDBProperties, IID_IDBCreateSession, pIDBCreateSession);
+		if (!pIDBCreateSession) goto cleanup;
+
+		hr = CALL(CreateSession, pIDBCreateSession, NULL, &IID_IDBCreateCommand, (IUnknown **) &H->pIDBCreateCommand);
+		if (!H->pIDBCreateCommand) goto cleanup;
+
+		if (!dbh->is_persistent) {
+			oledb_pool_attach(pool_key);
+		}
+	}
+	if (!dbh->is_persistent) {
+		H->poolKey = pool_key;
+		pool_key = NULL;
+	}
+
+	oledb_set_provider_key(dbh);
+	oledb_check_provider_capability(dbh TSRMLS_CC);
+	oledb_get_connection_info(dbh TSRMLS_CC);
+
+	/* interface for handling transaction */
+	QUERY_INTERFACE(H->pIDBCreateCommand, IID_ITransactionLocal, H->pITransactionLocal);
+
+cleanup:
+	for (i = 0; i < (sizeof(vars) / sizeof(vars[0])); i++) {
+		if (vars[i].freeme) {
+			efree(vars[i].optval);
+		}
+	}
+	SAFE_EFREE(pool_key);
+	SAFE_RELEASE(pIDBInitialize);
+	SAFE_RELEASE(pIDBCreateSession);
+	return hr;
+}
+
+HRESULT oledb_open_read_session(pdo_dbh_t *dbh TSRMLS_DC)
+{
+	pdo_oledb_db_handle *H = (pdo_oledb_db_handle *)dbh->driver_data;
+
+	struct pdo_data_src_parser vars[] = {
+		{ "dbname",		NULL,			0 },
+		{ "provider",	NULL,			0 },
+	};
+
+	int i;
+
+	HRESULT hr = S_OK;
+	IDataInitialize *pIDataInitialize;
+	IDBInitialize *pIDBInitialize = NULL;
+	IDBCreateSession *pIDBCreateSession = NULL;
+	CLSID clsid;
+
+	if (H->pIDBCreateCommandRead) {
+		return S_OK;
+	} else if (!H->readHost || H->readUnavailable) {
+		return E_FAIL;
+	}
+
+	_php_pdo_parse_data_source(dbh->data_source, dbh->data_source_len, vars, sizeof(vars) / sizeof(vars[0]));
+
+	/* the secondary gets its own login, outside the pool--ApplicationIntent only reaches a listener through a provider that knows it */
+	hr = oledb_get_mssql_provider(vars[1].optval, &clsid);
+	if (!SUCCEEDED(hr)) goto cleanup;
+	if (pIDataInitialize = oledb_get_data_initialize()) {
+		hr = CALL(CreateDBInstance, pIDataInitialize, &clsid, NULL, CLSCTX_INPROC_SERVER, NULL,
 								&IID_IDBInitialize, (IUnknown **) &pIDBInitialize);
 	} else {
-		/* otherwise create the object directly */
-		hr = CoCreateInstance(&CLSID_SQLOLEDB, NULL, CLSCTX_INPROC_SERVER,
+		hr = CoCreateInstance(&clsid, NULL, CLSCTX_INPROC_SERVER,
 								&IID_IDBInitialize, (void**) &pIDBInitialize);
 	}
 	if (!pIDBInitialize) goto cleanup;
 
-	/* Get an IDBProperties pointer */
-	hr = QUERY_INTERFACE(pIDBInitialize, IID_IDBProperties, H->pIDBProperties);
-	if (!H->pIDBProperties) goto cleanup;
+	hr = QUERY_INTERFACE(pIDBInitialize, IID_IDBProperties, H->pIDBPropertiesRead);
+	if (!H->pIDBPropertiesRead) goto cleanup;
 
-	/* Set initialization properties */
-	oledb_set_initialization_properties(dbh, host, dbname TSRMLS_CC);
+	hr = oledb_set_initialization_properties(dbh, H->pIDBPropertiesRead, H->readHost, vars[0].optval, TRUE TSRMLS_CC);
+	if (!SUCCEEDED(hr)) goto cleanup;
 
-	/* Connect to the database */
 	hr = CALL(Initialize, pIDBInitialize);
 	if (!SUCCEEDED(hr)) goto cleanup;
 
-	/* Create a session */
-	hr = QUERY_INTERFACE(pIDBInitialize, IID_IDBCreateSession, pIDBCreateSession);
+	hr = QUERY_INTERFACE(H->pIDBPropertiesRead, IID_IDBCreateSession, pIDBCreateSession);
 	if (!pIDBCreateSession) goto cleanup;
 
-	hr = CALL(CreateSession, pIDBCreateSession, NULL, &IID_IDBCreateCommand, (IUnknown **) &H->pIDBCreateCommand);
-	if (!H->pIDBCreateCommand) goto cleanup;
-
-	oledb_check_provider_capability(dbh TSRMLS_CC);
-
-	/* interface for handling transaction */
-	QUERY_INTERFACE(H->pIDBCreateCommand, IID_ITransactionLocal, H->pITransactionLocal);
-
-	dbh->alloc_own_columns = 1;
-	dbh->max_escaped_char_length = 2;
-	dbh->methods = &oledb_methods;
+	hr = CALL(CreateSession, pIDBCreateSession, NULL, &IID_IDBCreateCommand, (IUnknown **) &H->pIDBCreateCommandRead);
 
 cleanup:
+	if (!H->pIDBCreateCommandRead) {
+		/* reads go to the primary from here on instead of retrying the login every statement */
+		oledb_release_read_session(H);
+		H->readUnavailable = TRUE;
+		if (SUCCEEDED(hr)) {
+			hr = E_FAIL;
+		}
+	}
 	for (i = 0; i < (sizeof(vars) / sizeof(vars[0])); i++) {
 		if (vars[i].freeme) {
 			efree(vars[i].optval);
@@ -1201,6 +2163,38 @@ cleanup:
 	}
 	SAFE_RELEASE(pIDBInitialize);
 	SAFE_RELEASE(pIDBCreateSession);
+	return hr;
+}
+
+static int oledb_handle_factory_mssql(pdo_dbh_t *dbh, zval *driver_options TSRMLS_DC) /* {{{ */
+{
+	pdo_oledb_db_handle *H;
+	HRESULT hr;
+
+	H = pecalloc(1, sizeof(*H), dbh->is_persistent);
+	dbh->driver_data = H;
+	H->flags = CONVERT_DATE_TIME;
+	H->loginFlags = RESET_ON_REUSE;
+	H->packetSize = PDO_OLEDB_PACKET_SIZE_AUTO;
+	H->timeout = 30;
+	H->connect = oledb_connect_mssql;
+	oledb_create_conversion_options(&H->conv, dbh->is_persistent);
+	oledb_create_statement_cache(&H->cache, PDO_OLEDB_STATEMENT_CACHE_SIZE, dbh->is_persistent);
+
+	hr = oledb_set_driver_options(dbh, driver_options TSRMLS_CC);
+	if (!SUCCEEDED(hr)) goto cleanup;
+
+	/* with lazy connect, logging in waits until something needs the session */
+	if (!(H->loginFlags & LAZY_CONNECT)) {
+		hr = oledb_connect_mssql(dbh TSRMLS_CC);
+		if (!SUCCEEDED(hr)) goto cleanup;
+	}
+
+	dbh->alloc_own_columns = 1;
+	dbh->max_escaped_char_length = 2;
+	dbh->methods = &oledb_methods;
+
+cleanup:
 	pdo_oledb_error(dbh, hr);
 	return SUCCEEDED(hr);
 }
@@ -1212,7 +2206,7 @@ static HRESULT oledb_merge_settings(pdo_dbh_t *dbh TSRMLS_DC)
 
 	HRESULT hr;
 	DBPROPID prop_ids0[] = { DBPROPVAL_OS_RESOURCEPOOLING, DBPROP_INIT_TIMEOUT, DBPROP_AUTH_INTEGRATED, DBPROP_AUTH_PASSWORD, DBPROP_AUTH_USERID };
-	DBPROPID prop_ids1[] = { SSPROP_INIT_AUTOTRANSLATE, SSPROP_INIT_ENCRYPT, SSPROP_INIT_APPNAME };
+	DBPROPID prop_ids1[] = { SSPROP_INIT_AUTOTRANSLATE, SSPROP_INIT_ENCRYPT, SSPROP_INIT_APPNAME, SSPROP_INIT_PACKETSIZE };
 	DBPROPIDSET prop_id_sets[2];  
 	ULONG prop_set_count = 2, i, j;
 	DBPROPSET *prop_sets = NULL;
@@ -1220,7 +2214,7 @@ static HRESULT oledb_merge_settings(pdo_dbh_t *dbh TSRMLS_DC)
 	prop_id_sets[0].cPropertyIDs = sizeof(prop_ids0) /sizeof(prop_ids0[0]);
 	prop_id_sets[0].guidPropertySet = DBPROPSET_DBINIT;
 	prop_id_sets[0].rgPropertyIDs = prop_ids0;
-	prop_id_sets[1].cPropertyIDs = sizeof(prop_ids0) /sizeof(prop_ids0[0]);
+	prop_id_sets[1].cPropertyIDs = sizeof(prop_ids1) /sizeof(prop_ids1[0]);
 	prop_id_sets[1].guidPropertySet = DBPROPSET_SQLSERVERDBINIT;
 	prop_id_sets[1].rgPropertyIDs = prop_ids1;
 
@@ -1278,6 +2272,12 @@ static HRESULT oledb_merge_settings(pdo_dbh_t *dbh TSRMLS_DC)
 							}
 						}
 						break;
+					case SSPROP_INIT_PACKETSIZE:
+						/* an explicit size in the init-string wins over auto */
+						if (V_VT(value) == VT_I4 && V_I4(value) > 0 && H->packetSize == PDO_OLEDB_PACKET_SIZE_AUTO) {
+							H->packetSize = V_I4(value);
+						}
+						break;
 				}
 			}
 		}
@@ -1291,68 +2291,130 @@ cleanup:
 	return hr;
 }
 
-static int oledb_handle_factory_oledb(pdo_dbh_t *dbh, zval *driver_options TSRMLS_DC) /* {{{ */
+static HRESULT oledb_connect_oledb(pdo_dbh_t *dbh TSRMLS_DC)
 {
-	pdo_oledb_db_handle *H;
+	pdo_oledb_db_handle *H = (pdo_oledb_db_handle *)dbh->driver_data;
 
-	HRESULT hr;
+	HRESULT hr = S_OK;
+	IDataInitialize *pIDataInitialize;
 	IDBCreateSession *pIDBCreateSession = NULL;
 	IDBInitialize *pIDBInitialize = NULL;
+	char *pool_key = NULL;
+	BOOL pooled = FALSE, share;
 
 	const char *init_str = dbh->data_source;
 	BSTR init_str_w = NULL;
 
-	H = pecalloc(1, sizeof(*H), dbh->is_persistent);
-	dbh->driver_data = H;
-	H->flags = CONVERT_DATE_TIME;
-	oledb_create_conversion_options(&H->conv, dbh->is_persistent);
-
-	hr = oledb_set_driver_options(dbh, driver_options TSRMLS_CC);
-	if (!SUCCEEDED(hr)) goto cleanup;
-
 	oledb_create_bstr(H->conv, init_str, -1, &init_str_w, NULL, CONVERT_FROM_INPUT_TO_UNICODE);
 
+	pIDataInitialize = oledb_get_data_initialize();
 	if (!pIDataInitialize) goto cleanup;
 
-	/* Get data source through MDAC */
-	hr = CALL(GetDataSource, pIDataInitialize, NULL, CLSCTX_INPROC_SERVER, init_str_w,
-							  &IID_IDBInitialize, (IUnknown **) &pIDBInitialize);
+	pool_key = oledb_pool_make_key(dbh, "oledb");
 
-	/* Get an IDBProperties pointer */
-	hr = QUERY_INTERFACE(pIDBInitialize, IID_IDBProperties, H->pIDBProperties);
-	if (!H->pIDBProperties) goto cleanup;
+	/* persistent handles are kept by PDO already */
+	if (!dbh->is_persistent) {
+		pooled = oledb_pool_checkout(pool_key, NULL, &H->pIDBProperties, &H->pIDBCreateCommand);
+	}
 
-	/* Set initialization properties */
-	hr = oledb_set_initialization_properties(dbh, NULL, NULL TSRMLS_CC);
-	if (!SUCCEEDED(hr)) goto cleanup;
+	if (pooled) {
+		/* pick up settings from the init-string */
+		oledb_merge_settings(dbh TSRMLS_CC);
+	} else {
+		/* another handle might have logged in with the same settings already--a session
+		   that gets reset (pooled or reset on reuse) does so through its data source, so it
+		   gets one of its own */
+		share = (dbh->is_persistent || !oledb_pool_is_enabled()) && !(H->loginFlags & RESET_ON_REUSE);
+		if (share) {
+			H->pIDBProperties = oledb_pool_get_data_source(pool_key);
+		}
+		if (H->pIDBProperties) {
+			oledb_merge_settings(dbh TSRMLS_CC);
+		} else {
+			/* Get data source through MDAC */
+			hr = CALL(GetDataSource, pIDataInitialize, NULL, CLSCTX_INPROC_SERVER, init_str_w,
+									  &IID_IDBInitialize, (IUnknown **) &pIDBInitialize);
 
-	/* merge settings from init-string with driver_options array */
-	oledb_merge_settings(dbh TSRMLS_CC);
+			/* Get an IDBProperties pointer */
+			hr = QUERY_INTERFACE(pIDBInitialize, IID_IDBProperties, H->pIDBProperties);
+			if (!H->pIDBProperties) goto cleanup;
 
-	/* Connect to the database */
-	hr = CALL(Initialize, pIDBInitialize);
-	if (!SUCCEEDED(hr)) goto cleanup;
+			/* Set initialization properties */
+			oledb_set_provider_key(dbh);
+			hr = oledb_set_initialization_properties(dbh, H->pIDBProperties, NULL, NULL, FALSE TSRMLS_CC);
+			if (!SUCCEEDED(hr)) goto cleanup;
 
-	/* Create a session */
-	hr = QUERY_INTERFACE(pIDBInitialize, IID_IDBCreateSession, pIDBCreateSession);
-	if (!pIDBCreateSession) goto cleanup;
+			/* merge settings from init-string with driver_options array */
+			oledb_merge_settings(dbh TSRMLS_CC);
+
+			/* Connect to the database */
+			hr = CALL(Initialize, pIDBInitialize);
+			if (!SUCCEEDED(hr)) goto cleanup;
+
+			if (share) {
+				oledb_pool_add_data_source(pool_key, H->pIDBProperties);
+			}
+		}
+
+		/* Create a session */
+		hr = QUERY_INTERFACE(H->pIDBProperties, IID_IDBCreateSession, pIDBCreateSession);
+		if (!pIDBCreateSession) goto cleanup;
 
-	hr = CALL(CreateSession, pIDBCreateSession, NULL, &IID_IDBCreateCommand, (IUnknown **) &H->pIDBCreateCommand);
-	if (!H->pIDBCreateCommand) goto cleanup;
+		hr = CALL(CreateSession, pIDBCreateSession, NULL, &IID_IDBCreateCommand, (IUnknown **) &H->pIDBCreateCommand);
+		if (!H->pIDBCreateCommand) goto cleanup;
 
+		if (!dbh->is_persistent) {
+			oledb_pool_attach(pool_key);
+		}
+	}
+	if (!dbh->is_persistent) {
+		H->poolKey = pool_key;
+		pool_key = NULL;
+	}
+
+	oledb_set_provider_key(dbh);
 	oledb_check_provider_capability(dbh TSRMLS_CC);
+	oledb_get_connection_info(dbh TSRMLS_CC);
 
 	/* interface for handling transaction */
 	QUERY_INTERFACE(H->pIDBCreateCommand, IID_ITransactionLocal, H->pITransactionLocal);
 
+cleanup:
+	SysFreeString(init_str_w);
+	SAFE_EFREE(pool_key);
+	SAFE_RELEASE(pIDBInitialize);
+	SAFE_RELEASE(pIDBCreateSession);
+	return hr;
+}
+
+static int oledb_handle_factory_oledb(pdo_dbh_t *dbh, zval *driver_options TSRMLS_DC) /* {{{ */
+{
+	pdo_oledb_db_handle *H;
+	HRESULT hr;
+
+	H = pecalloc(1, sizeof(*H), dbh->is_persistent);
+	dbh->driver_data = H;
+	H->flags = CONVERT_DATE_TIME;
+	H->loginFlags = RESET_ON_REUSE;
+	H->packetSize = PDO_OLEDB_PACKET_SIZE_AUTO;
+	H->connect = oledb_connect_oledb;
+	oledb_create_conversion_options(&H->conv, dbh->is_persistent);
+	oledb_create_statement_cache(&H->cache, PDO_OLEDB_STATEMENT_CACHE_SIZE, dbh->is_persistent);
+
+	hr = oledb_set_driver_options(dbh, driver_options TSRMLS_CC);
+	if (!SUCCEEDED(hr)) goto cleanup;
+
+	/* with lazy connect, logging in waits until something needs the session */
+	if (!(H->loginFlags & LAZY_CONNECT)) {
+		hr = oledb_connect_oledb(dbh TSRMLS_CC);
+		if (!SUCCEEDED(hr)) goto cleanup;
+	}
+
 	dbh->alloc_own_columns = 1;
 	dbh->max_escaped_char_length = 2;
 	dbh->methods = &oledb_methods;
 
 cleanup:
-	SysFreeString(init_str_w);
-	SAFE_RELEASE(pIDBInitialize);
-	SAFE_RELEASE(pIDBCreateSession);
 	pdo_oledb_error(dbh, hr);
 	return SUCCEEDED(hr);
 }
@@ -0,0 +1,449 @@
+/*
+  +----------------------------------------------------------------------+
+  | PHP Version 5                                                        |
+  +----------------------------------------------------------------------+
+  | Copyright (c) 1997-2007 The PHP Group                                |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 3.0 of the PHP license,       |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.php.net/license/3_0.txt.                                  |
+  | If you did not receive a copy of the PHP license and are unable to   |
+  | obtain it through the world-wide-web, please send a note to          |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Chung Leong <cleong@cal.berkeley.edu>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "php_ini.h"
+#include "ext/standard/info.h"
+#include "pdo/php_pdo.h"
+#include "pdo/php_pdo_driver.h"
+#include "php_pdo_oledb.h"
+#include "php_pdo_oledb_int.h"
+
+/*
+	Sessions of non-persistent handles are kept here between requests, along with
+	initialized data sources that new handles open their sessions on and provider
+	capabilities probed on connect. All are process-wide, so in a threaded server the provider has to be free-threaded
+	(SQLOLEDB and SQL Native Client are).
+*/
+
+static CRITICAL_SECTION pool_lock;
+static pdo_oledb_connection_pool *pools = NULL;
+static pdo_oledb_shared_data_source *data_sources = NULL;
+static pdo_oledb_cached_property *properties = NULL;
+static long pool_max_size = 0;
+static long pool_min_size = 0;
+static long pool_idle_timeout = 0;
+static BOOL share_data_sources = FALSE;
+
+void oledb_pool_startup(long max_size, long min_size, long idle_timeout, BOOL share)
+{
+	InitializeCriticalSection(&pool_lock);
+	pool_max_size = max_size;
+	pool_min_size = (min_size < max_size) ? min_size : max_size;
+	pool_idle_timeout = idle_timeout;
+	share_data_sources = share;
+}
+
+static void oledb_pool_release_connection(pdo_oledb_pooled_connection *conn)
+{
+	SAFE_RELEASE(conn->pIDBCreateCommand);
+	SAFE_RELEASE(conn->pIDBProperties);
+	pefree(conn, 1);
+}
+
+void oledb_pool_shutdown(void)
+{
+	EnterCriticalSection(&pool_lock);
+	while (pools) {
+		pdo_oledb_connection_pool *pool = pools;
+		pools = pool->next;
+		while (pool->idle) {
+			pdo_oledb_pooled_connection *conn = pool->idle;
+			pool->idle = conn->next;
+			oledb_pool_release_connection(conn);
+		}
+		pefree(pool->key, 1);
+		pefree(pool->label, 1);
+		pefree(pool, 1);
+	}
+	while (data_sources) {
+		pdo_oledb_shared_data_source *ds = data_sources;
+		data_sources = ds->next;
+		RELEASE(ds->pIDBProperties);
+		pefree(ds->key, 1);
+		pefree(ds, 1);
+	}
+	while (properties) {
+		pdo_oledb_cached_property *prop = properties;
+		properties = prop->next;
+		VariantClear(&prop->value);
+		pefree(prop->key, 1);
+		pefree(prop, 1);
+	}
+	LeaveCriticalSection(&pool_lock);
+	DeleteCriticalSection(&pool_lock);
+}
+
+char *oledb_pool_make_key(pdo_dbh_t *dbh, const char *driver_name)
+{
+	pdo_oledb_db_handle *H = (pdo_oledb_db_handle *)dbh->driver_data;
+	DWORD flags = H->flags & (SECURE_CONNECTION | CONNECTION_POOLING | ENCRYPTION | AUTOTRANSLATE);
+	char *key;
+
+	/* lengths are included so one field can't run into the next */
+	spprintf(&key, 0, "%s|%d:%s|%d:%s|%d:%s|%d:%s|%lx|%lx|%ld|%ld", driver_name,
+		dbh->data_source_len, dbh->data_source,
+		strlen(SAFE_STRING(dbh->username)), SAFE_STRING(dbh->username),
+		strlen(SAFE_STRING(dbh->password)), SAFE_STRING(dbh->password),
+		strlen(SAFE_STRING(H->appname)), SAFE_STRING(H->appname),
+		flags, H->loginFlags & BULK_TRANSFER, H->timeout, H->packetSize);
+	return key;
+}
+
+static pdo_oledb_connection_pool *oledb_pool_find(const char *key)
+{
+	pdo_oledb_connection_pool *pool;
+	for (pool = pools; pool; pool = pool->next) {
+		if (strcmp(pool->key, key) == 0) {
+			return pool;
+		}
+	}
+	return NULL;
+}
+
+static BOOL oledb_pool_check_connection(IDBProperties *pIDBProperties)
+{
+	HRESULT hr;
+	DBPROPID prop_id = DBPROP_CONNECTIONSTATUS;
+	DBPROPIDSET prop_id_set;
+	DBPROPSET *prop_sets = NULL;
+	ULONG prop_set_count = 0;
+	BOOL alive = FALSE;
+
+	/* a local call--the provider sets the status when it sees the link drop */
+	prop_id_set.cPropertyIDs = 1;
+	prop_id_set.guidPropertySet = DBPROPSET_DATASOURCEINFO;
+	prop_id_set.rgPropertyIDs = &prop_id;
+	hr = CALL(GetProperties, pIDBProperties, 1, &prop_id_set, &prop_set_count, &prop_sets);
+	if (hr == S_OK && prop_set_count == 1 && prop_sets[0].cProperties == 1) {
+		VARIANT *value = &prop_sets[0].rgProperties[0].vValue;
+		alive = (V_VT(value) == VT_I4 && V_I4(value) == DBPROPVAL_CS_INITIALIZED);
+		VariantClear(value);
+		CoTaskMemFree(prop_sets[0].rgProperties);
+	} else if (hr == DB_S_ERRORSOCCURRED || hr == DB_E_ERRORSOCCURRED) {
+		/* provider doesn't report connection status--assume the best */
+		alive = TRUE;
+		if (prop_sets) {
+			CoTaskMemFree(prop_sets[0].rgProperties);
+		}
+	}
+	CoTaskMemFree(prop_sets);
+	return alive;
+}
+
+static void oledb_pool_trim(DWORD now)
+{
+	pdo_oledb_connection_pool *pool;
+
+	if (pool_idle_timeout <= 0) {
+		return;
+	}
+	for (pool = pools; pool; pool = pool->next) {
+		pdo_oledb_pooled_connection **p = &pool->idle;
+		long kept = 0;
+
+		/* the list runs from most to least recently used */
+		while (*p) {
+			pdo_oledb_pooled_connection *conn = *p;
+			if (kept >= pool_min_size && now - conn->lastUsed > (DWORD) pool_idle_timeout * 1000) {
+				*p = conn->next;
+				oledb_pool_release_connection(conn);
+				pool->idleCount--;
+				pool->trimmed++;
+			} else {
+				p = &conn->next;
+				kept++;
+			}
+		}
+	}
+}
+
+BOOL oledb_pool_checkout(const char *key, const char *label, IDBProperties **ppIDBProperties, IDBCreateCommand **ppIDBCreateCommand)
+{
+	pdo_oledb_connection_pool *pool;
+	BOOL found = FALSE;
+
+	if (pool_max_size <= 0) {
+		return FALSE;
+	}
+
+	EnterCriticalSection(&pool_lock);
+	oledb_pool_trim(GetTickCount());
+	pool = oledb_pool_find(key);
+	if (!pool) {
+		pool = pecalloc(1, sizeof(*pool), 1);
+		pool->key = pestrdup(key, 1);
+		if (label) {
+			pool->label = pestrdup(label, 1);
+		} else {
+			/* don't show init-strings in phpinfo()--they can contain passwords */
+			char buffer[32];
+			sprintf(buffer, "#%08lx", zend_inline_hash_func((char *) key, strlen(key) + 1));
+			pool->label = pestrdup(buffer, 1);
+		}
+		pool->next = pools;
+		pools = pool;
+	}
+	while (pool->idle && !found) {
+		pdo_oledb_pooled_connection *conn = pool->idle;
+		pool->idle = conn->next;
+		pool->idleCount--;
+		if (oledb_pool_check_connection(conn->pIDBProperties)) {
+			*ppIDBProperties = conn->pIDBProperties;
+			*ppIDBCreateCommand = conn->pIDBCreateCommand;
+			pefree(conn, 1);
+			pool->activeCount++;
+			found = TRUE;
+		} else {
+			oledb_pool_release_connection(conn);
+			pool->failedChecks++;
+		}
+	}
+	if (found) {
+		pool->hits++;
+	} else {
+		pool->misses++;
+	}
+	LeaveCriticalSection(&pool_lock);
+	return found;
+}
+
+void oledb_pool_attach(const char *key)
+{
+	pdo_oledb_connection_pool *pool;
+
+	EnterCriticalSection(&pool_lock);
+	pool = oledb_pool_find(key);
+	if (pool) {
+		pool->activeCount++;
+	}
+	LeaveCriticalSection(&pool_lock);
+}
+
+void oledb_pool_checkin(const char *key, IDBProperties *pIDBProperties, IDBCreateCommand *pIDBCreateCommand)
+{
+	pdo_oledb_connection_pool *pool;
+	DWORD now = GetTickCount();
+
+	EnterCriticalSection(&pool_lock);
+	pool = oledb_pool_find(key);
+	if (pool) {
+		pool->activeCount--;
+		if (pool->idleCount < pool_max_size && pIDBProperties && pIDBCreateCommand) {
+			pdo_oledb_pooled_connection *conn = pecalloc(1, sizeof(*conn), 1);
+			conn->pIDBProperties = pIDBProperties;
+			conn->pIDBCreateCommand = pIDBCreateCommand;
+			ADDREF(pIDBProperties);
+			ADDREF(pIDBCreateCommand);
+			conn->lastUsed = now;
+			conn->next = pool->idle;
+			pool->idle = conn;
+			pool->idleCount++;
+		} else {
+			pool->discarded++;
+		}
+	}
+	oledb_pool_trim(now);
+	LeaveCriticalSection(&pool_lock);
+}
+
+BOOL oledb_pool_is_enabled(void)
+{
+	return (pool_max_size > 0);
+}
+
+IDBProperties *oledb_pool_get_data_source(const char *key)
+{
+	pdo_oledb_shared_data_source **p;
+	IDBProperties *pIDBProperties = NULL;
+
+	if (!share_data_sources) {
+		return NULL;
+	}
+
+	EnterCriticalSection(&pool_lock);
+	for (p = &data_sources; *p; p = &(*p)->next) {
+		pdo_oledb_shared_data_source *ds = *p;
+		if (strcmp(ds->key, key) == 0) {
+			if (oledb_pool_check_connection(ds->pIDBProperties)) {
+				pIDBProperties = ds->pIDBProperties;
+				ADDREF(pIDBProperties);
+				ds->sessionCount++;
+			} else {
+				/* handles still using it keep their own references */
+				*p = ds->next;
+				RELEASE(ds->pIDBProperties);
+				pefree(ds->key, 1);
+				pefree(ds, 1);
+			}
+			break;
+		}
+	}
+	LeaveCriticalSection(&pool_lock);
+	return pIDBProperties;
+}
+
+void oledb_pool_add_data_source(const char *key, IDBProperties *pIDBProperties)
+{
+	pdo_oledb_shared_data_source *ds;
+
+	if (!share_data_sources) {
+		return;
+	}
+
+	EnterCriticalSection(&pool_lock);
+	ds = pecalloc(1, sizeof(*ds), 1);
+	ds->key = pestrdup(key, 1);
+	ds->pIDBProperties = pIDBProperties;
+	ADDREF(pIDBProperties);
+	ds->sessionCount = 1;
+	ds->next = data_sources;
+	data_sources = ds;
+	LeaveCriticalSection(&pool_lock);
+}
+
+void oledb_pool_release_data_source(IDBProperties *pIDBProperties)
+{
+	pdo_oledb_shared_data_source *ds;
+
+	if (!share_data_sources || !pIDBProperties) {
+		return;
+	}
+
+	/* the handle's own reference is released by the caller */
+	EnterCriticalSection(&pool_lock);
+	for (ds = data_sources; ds; ds = ds->next) {
+		if (ds->pIDBProperties == pIDBProperties) {
+			ds->sessionCount--;
+			break;
+		}
+	}
+	LeaveCriticalSection(&pool_lock);
+}
+
+BOOL oledb_pool_is_shared_data_source(IDBProperties *pIDBProperties)
+{
+	pdo_oledb_shared_data_source *ds;
+	BOOL found = FALSE;
+
+	if (!share_data_sources) {
+		return FALSE;
+	}
+
+	EnterCriticalSection(&pool_lock);
+	for (ds = data_sources; ds && !found; ds = ds->next) {
+		found = (ds->pIDBProperties == pIDBProperties);
+	}
+	LeaveCriticalSection(&pool_lock);
+	return found;
+}
+
+static pdo_oledb_cached_property *oledb_pool_find_property(const char *key, const GUID *prop_set_id, DBPROPID prop_id)
+{
+	pdo_oledb_cached_property *prop;
+	for (prop = properties; prop; prop = prop->next) {
+		if (prop->propId == prop_id && IsEqualGUID(&prop->propSetId, prop_set_id) && strcmp(prop->key, key) == 0) {
+			return prop;
+		}
+	}
+	return NULL;
+}
+
+BOOL oledb_pool_get_property(const char *key, const GUID *prop_set_id, DBPROPID prop_id, BOOL *pSupported, VARIANT *pVar)
+{
+	pdo_oledb_cached_property *prop;
+
+	EnterCriticalSection(&pool_lock);
+	prop = oledb_pool_find_property(key, prop_set_id, prop_id);
+	if (prop) {
+		*pSupported = prop->supported;
+		if (pVar) {
+			VariantInit(pVar);
+			VariantCopy(pVar, &prop->value);
+		}
+	}
+	LeaveCriticalSection(&pool_lock);
+	return (prop != NULL);
+}
+
+void oledb_pool_set_property(const char *key, const GUID *prop_set_id, DBPROPID prop_id, BOOL supported, VARIANT *pVar)
+{
+	pdo_oledb_cached_property *prop;
+
+	EnterCriticalSection(&pool_lock);
+	/* another thread might have got there first */
+	if (!oledb_pool_find_property(key, prop_set_id, prop_id)) {
+		prop = pecalloc(1, sizeof(*prop), 1);
+		prop->key = pestrdup(key, 1);
+		prop->propSetId = *prop_set_id;
+		prop->propId = prop_id;
+		prop->supported = supported;
+		VariantInit(&prop->value);
+		if (pVar) {
+			VariantCopy(&prop->value, pVar);
+		}
+		prop->next = properties;
+		properties = prop;
+	}
+	LeaveCriticalSection(&pool_lock);
+}
+
+void oledb_pool_info(void)
+{
+	pdo_oledb_connection_pool *pool;
+	char buffer[6][32];
+
+	if (share_data_sources) {
+		pdo_oledb_shared_data_source *ds;
+		long count = 0, sessions = 0;
+
+		EnterCriticalSection(&pool_lock);
+		for (ds = data_sources; ds; ds = ds->next) {
+			count++;
+			sessions += ds->sessionCount;
+		}
+		LeaveCriticalSection(&pool_lock);
+		sprintf(buffer[0], "%ld", count);
+		sprintf(buffer[1], "%ld", sessions);
+		php_info_print_table_row(2, "Shared data sources", buffer[0]);
+		php_info_print_table_row(2, "Sessions on shared data sources", buffer[1]);
+	}
+
+	if (pool_max_size <= 0) {
+		return;
+	}
+
+	EnterCriticalSection(&pool_lock);
+	if (pools) {
+		php_info_print_table_header(7, "Connection pool", "Idle", "In use", "Hits", "Misses", "Failed checks", "Trimmed");
+		for (pool = pools; pool; pool = pool->next) {
+			sprintf(buffer[0], "%ld", pool->idleCount);
+			sprintf(buffer[1], "%ld", pool->activeCount);
+			sprintf(buffer[2], "%ld", pool->hits);
+			sprintf(buffer[3], "%ld", pool->misses);
+			sprintf(buffer[4], "%ld", pool->failedChecks);
+			sprintf(buffer[5], "%ld", pool->trimmed + pool->discarded);
+			php_info_print_table_row(7, pool->label, buffer[0], buffer[1], buffer[2], buffer[3], buffer[4], buffer[5]);
+		}
+	}
+	LeaveCriticalSection(&pool_lock);
+}
@@ -0,0 +1,1065 @@
+/*
+  +----------------------------------------------------------------------+
+  | PHP Version 5                                                        |
+  +----------------------------------------------------------------------+
+  | Copyright (c) 1997-2007 The PHP Group                                |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 3.0 of the PHP license,       |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.php.net/license/3_0.txt.                                  |
+  | If you did not receive a copy of the PHP license and are unable to   |
+  | obtain it through the world-wide-web, please send a note to          |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Chung Leong <cleong@cal.berkeley.edu>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "php_ini.h"
+#include "ext/standard/info.h"
+#include "pdo/php_pdo.h"
+#include "pdo/php_pdo_driver.h"
+#include "php_pdo_oledb.h"
+#include "php_pdo_oledb_int.h"
+
+#include <msdadc.h>
+
+/* a read-only, forward-only rowset that hands the rows of a PHP array or Traversable to the
+   provider as it sends a table-valued parameter
+*/
+
+typedef struct {
+	char *key;
+	uint keyLen;
+	ulong index;
+	BSTR name;
+	DBTYPE type;
+} zval_rowset_column;
+
+typedef struct zval_rowset_accessor {
+	struct zval_rowset_accessor *next;
+	DBACCESSORFLAGS flags;
+	DBCOUNTITEM binding_count;
+	DBBINDING *bindings;
+	ULONG refcount;
+} zval_rowset_accessor;
+
+typedef struct {
+	IRowsetVtbl *lpIRowsetVtbl;
+	IAccessorVtbl *lpIAccessorVtbl;
+	IColumnsInfoVtbl *lpIColumnsInfoVtbl;
+	IRowsetInfoVtbl *lpIRowsetInfoVtbl;
+
+	zval *source;
+	HashPosition position;
+	zend_object_iterator *iterator;
+	int advance;
+	zval *pending;
+
+	zval_rowset_column *columns;
+	DBORDINAL column_count;
+
+	zval **rows;
+	ULONG *row_refcounts;
+	DBCOUNTITEM row_count;
+
+	zval_rowset_accessor *accessors;
+	IDataConvert *pIDataConvert;
+	pdo_oledb_conversion *conv;
+	ULONG refcount;
+	void *tsrm_ls;
+} zval_rowset;
+
+#define DECLARE_THIS(vtbl, offset)		zval_rowset *this = ((zval_rowset *) &((IUnknown *) vtbl)[- offset])
+
+static HRESULT zval_rowset_fetch(zval_rowset *this, zval **pRow)
+{
+	void *tsrm_ls = this->tsrm_ls;
+	zval **data = NULL;
+
+	if (this->pending) {
+		/* the row that was looked at to figure out the columns */
+		*pRow = this->pending;
+		this->pending = NULL;
+		return S_OK;
+	}
+	if (this->iterator) {
+		zend_object_iterator *iter = this->iterator;
+
+		if (this->advance) {
+			iter->funcs->move_forward(iter TSRMLS_CC);
+			this->advance = FALSE;
+		}
+		if (EG(exception)) {
+			goto exception;
+		}
+		if (iter->funcs->valid(iter TSRMLS_CC) != SUCCESS) {
+			return (EG(exception)) ? E_FAIL : S_FALSE;
+		}
+		iter->funcs->get_current_data(iter, &data TSRMLS_CC);
+		if (EG(exception) || !data || !*data) {
+			goto exception;
+		}
+		this->advance = TRUE;
+	} else {
+		HashTable *ht = Z_ARRVAL_P(this->source);
+		if (zend_hash_get_current_data_ex(ht, (void **) &data, &this->position) != SUCCESS) {
+			return S_FALSE;
+		}
+		zend_hash_move_forward_ex(ht, &this->position);
+	}
+	Z_ADDREF_P(*data);
+	*pRow = *data;
+	return S_OK;
+
+exception:
+	oledb_set_automation_error(L"Exception thrown while retrieving table rows", L"HY000");
+	return E_FAIL;
+}
+
+static void zval_rowset_release_rows(zval_rowset *this)
+{
+	void *tsrm_ls = this->tsrm_ls;
+	DBCOUNTITEM i;
+
+	for (i = 0; i < this->row_count; i++) {
+		if (this->rows[i]) {
+			zval_ptr_dtor(&this->rows[i]);
+			this->rows[i] = NULL;
+		}
+	}
+	this->row_count = 0;
+}
+
+static zval_rowset_accessor *zval_rowset_find_accessor(zval_rowset *this, HACCESSOR hAccessor)
+{
+	zval_rowset_accessor *accessor;
+
+	for (accessor = this->accessors; accessor; accessor = accessor->next) {
+		if ((HACCESSOR) accessor == hAccessor) {
+			return accessor;
+		}
+	}
+	return NULL;
+}
+
+static DBTYPE zval_rowset_get_column_type(zval *value TSRMLS_DC)
+{
+	zend_class_entry *ce;
+
+	switch (Z_TYPE_P(value)) {
+		case IS_LONG:
+			return DBTYPE_I8;
+		case IS_DOUBLE:
+			return DBTYPE_R8;
+		case IS_BOOL:
+			return DBTYPE_BOOL;
+		case IS_OBJECT:
+			ce = oledb_get_datetime_ce(TSRMLS_C);
+			if (ce && instanceof_function(Z_OBJCE_P(value), ce TSRMLS_CC)) {
+				return DBTYPE_DBTIMESTAMP;
+			}
+			break;
+	}
+	/* let the provider convert from text when we don't know any better */
+	return DBTYPE_WSTR;
+}
+
+static HRESULT zval_rowset_describe_columns(zval_rowset *this, zval *row)
+{
+	void *tsrm_ls = this->tsrm_ls;
+	HRESULT hr = S_OK;
+
+	if (Z_TYPE_P(row) == IS_ARRAY) {
+		HashTable *ht = Z_ARRVAL_P(row);
+		HashPosition pos;
+		zval **data;
+		DBORDINAL i = 0;
+
+		this->column_count = zend_hash_num_elements(ht);
+		this->columns = ecalloc(max(this->column_count, 1), sizeof(*this->columns));
+
+		zend_hash_internal_pointer_reset_ex(ht, &pos);
+		while (zend_hash_get_current_data_ex(ht, (void **) &data, &pos) == SUCCESS) {
+			zval_rowset_column *column = &this->columns[i++];
+			char *key;
+			uint key_len;
+			ulong index;
+
+			/* keys in the first row decide how the values in the others are found */
+			if (zend_hash_get_current_key_ex(ht, &key, &key_len, &index, FALSE, &pos) == HASH_KEY_IS_STRING) {
+				UINT name_len;
+				column->key = estrndup(key, key_len - 1);
+				column->keyLen = key_len;
+				hr = oledb_create_bstr(this->conv, key, key_len - 1, &column->name, &name_len, CONVERT_FROM_INPUT_TO_UNICODE);
+				if (!SUCCEEDED(hr)) break;
+			} else {
+				column->index = index;
+			}
+			column->type = zval_rowset_get_column_type(*data TSRMLS_CC);
+			zend_hash_move_forward_ex(ht, &pos);
+		}
+	} else {
+		/* a list of scalars fills a single-column table */
+		this->column_count = 1;
+		this->columns = ecalloc(1, sizeof(*this->columns));
+		this->columns[0].type = zval_rowset_get_column_type(row TSRMLS_CC);
+	}
+	return hr;
+}
+
+static zval *zval_rowset_get_value(zval_rowset *this, zval *row, DBORDINAL ordinal)
+{
+	zval_rowset_column *column = &this->columns[ordinal - 1];
+	zval **data;
+	int result;
+
+	if (Z_TYPE_P(row) != IS_ARRAY) {
+		return (ordinal == 1) ? row : NULL;
+	}
+	if (column->key) {
+		result = zend_hash_find(Z_ARRVAL_P(row), column->key, column->keyLen, (void **) &data);
+	} else {
+		result = zend_hash_index_find(Z_ARRVAL_P(row), column->index, (void **) &data);
+	}
+	return (result == SUCCESS) ? *data : NULL;
+}
+
+static DBSTATUS zval_rowset_get_column_data(zval_rowset *this, zval *value, DBBINDING *binding, BYTE *pData)
+{
+	void *tsrm_ls = this->tsrm_ls;
+	HRESULT hr = S_OK;
+	DBSTATUS status = DBSTATUS_S_OK;
+	DBTYPE dst_type = binding->wType & ~DBTYPE_BYREF;
+	DBTYPE src_type = DBTYPE_EMPTY;
+	void *src = NULL;
+	DBLENGTH src_len = 0, dst_len = 0;
+	LONGLONG bigint_value;
+	double double_value;
+	VARIANT_BOOL bool_value;
+	DBTIMESTAMP timestamp_value;
+	BSTR unicode = NULL;
+	char *varchar = NULL;
+	zval copy;
+	int own_copy = FALSE;
+
+	if (!value || Z_TYPE_P(value) == IS_NULL) {
+		status = DBSTATUS_S_ISNULL;
+	} else if (Z_TYPE_P(value) == IS_LONG) {
+		bigint_value = Z_LVAL_P(value);
+		src_type = DBTYPE_I8;
+		src = &bigint_value;
+	} else if (Z_TYPE_P(value) == IS_DOUBLE) {
+		double_value = Z_DVAL_P(value);
+		src_type = DBTYPE_R8;
+		src = &double_value;
+	} else if (Z_TYPE_P(value) == IS_BOOL) {
+		bool_value = (Z_LVAL_P(value)) ? VARIANT_TRUE : VARIANT_FALSE;
+		src_type = DBTYPE_BOOL;
+		src = &bool_value;
+	} else if (Z_TYPE_P(value) == IS_OBJECT && zval_rowset_get_column_type(value TSRMLS_CC) == DBTYPE_DBTIMESTAMP) {
+		hr = oledb_get_timestamp(value, &timestamp_value TSRMLS_CC);
+		src_type = DBTYPE_DBTIMESTAMP;
+		src = &timestamp_value;
+	} else {
+		copy = *value;
+		zval_copy_ctor(&copy);
+		convert_to_string(&copy);
+		own_copy = TRUE;
+
+		if (dst_type == DBTYPE_BYTES) {
+			/* binary data goes as is */
+			src_type = DBTYPE_BYTES;
+			src = Z_STRVAL(copy);
+			src_len = Z_STRLEN(copy);
+		} else if (dst_type == DBTYPE_STR) {
+			UINT len = Z_STRLEN(copy);
+			char *s = Z_STRVAL(copy);
+			hr = oledb_convert_string(this->conv, s, len, &s, &len, CONVERT_FROM_INPUT_TO_VARCHAR);
+			if (hr != S_FALSE) {
+				/* buffer needs to be freed */
+				varchar = s;
+			}
+			src_type = DBTYPE_STR;
+			src = s;
+			src_len = len;
+		} else {
+			UINT unicode_len;
+			hr = oledb_create_bstr(this->conv, Z_STRVAL(copy), Z_STRLEN(copy), &unicode, &unicode_len, CONVERT_FROM_INPUT_TO_UNICODE);
+			src_type = DBTYPE_WSTR;
+			src = unicode;
+			src_len = unicode_len * sizeof(WCHAR);
+		}
+	}
+
+	if (status == DBSTATUS_S_OK) {
+		if (!SUCCEEDED(hr)) {
+			status = DBSTATUS_E_CANTCONVERTVALUE;
+		} else if (binding->dwPart & DBPART_VALUE) {
+			/* the conversion library allocates the memory when the provider asks for a reference */
+			hr = CALL(DataConvert, this->pIDataConvert, src_type, binding->wType, src_len, &dst_len, src,
+				pData + binding->obValue, binding->cbMaxLen, DBSTATUS_S_OK, &status, binding->bPrecision, binding->bScale, DBDATACONVERT_DEFAULT);
+			if (!SUCCEEDED(hr) && status == DBSTATUS_S_OK) {
+				status = DBSTATUS_E_CANTCONVERTVALUE;
+			}
+		} else {
+			hr = CALL(GetConversionSize, this->pIDataConvert, src_type, binding->wType, &src_len, &dst_len, src);
+			if (!SUCCEEDED(hr)) {
+				status = DBSTATUS_E_CANTCONVERTVALUE;
+			}
+		}
+	}
+
+	if (binding->dwPart & DBPART_LENGTH) {
+		*(DBLENGTH *) (pData + binding->obLength) = dst_len;
+	}
+	if (binding->dwPart & DBPART_STATUS) {
+		*(DBSTATUS *) (pData + binding->obStatus) = status;
+	}
+
+	SysFreeString(unicode);
+	SAFE_EFREE(varchar);
+	if (own_copy) {
+		zval_dtor(&copy);
+	}
+	return status;
+}
+
+static HRESULT zval_rowset_QueryInterface(zval_rowset *this,
+            /* [in] */ REFIID riid,
+            /* [iid_is][out] */ void **ppvObject)
+{
+	if (IsEqualIID(riid, &IID_IUnknown) || IsEqualIID(riid, &IID_IRowset)) {
+		*ppvObject = &this->lpIRowsetVtbl;
+	} else if (IsEqualIID(riid, &IID_IAccessor)) {
+		*ppvObject = &this->lpIAccessorVtbl;
+	} else if (IsEqualIID(riid, &IID_IColumnsInfo)) {
+		*ppvObject = &this->lpIColumnsInfoVtbl;
+	} else if (IsEqualIID(riid, &IID_IRowsetInfo)) {
+		*ppvObject = &this->lpIRowsetInfoVtbl;
+	} else {
+		*ppvObject = NULL;
+		return E_NOINTERFACE;
+	}
+	ADDREF((IUnknown *) *ppvObject);
+	return S_OK;
+}
+
+static ULONG zval_rowset_AddRef(zval_rowset *this)
+{
+	return ++(this->refcount);
+}
+
+static ULONG zval_rowset_Release(zval_rowset *this)
+{
+	if(--(this->refcount) == 0) {
+		void *tsrm_ls = this->tsrm_ls;
+		DBORDINAL i;
+
+		zval_rowset_release_rows(this);
+		CoTaskMemFree(this->rows);
+		CoTaskMemFree(this->row_refcounts);
+		if (this->pending) {
+			zval_ptr_dtor(&this->pending);
+		}
+		if (this->iterator) {
+			this->iterator->funcs->dtor(this->iterator TSRMLS_CC);
+		}
+		if (this->source) {
+			zval_ptr_dtor(&this->source);
+		}
+		for (i = 0; i < this->column_count; i++) {
+			SAFE_EFREE(this->columns[i].key);
+			SysFreeString(this->columns[i].name);
+		}
+		SAFE_EFREE(this->columns);
+		while (this->accessors) {
+			zval_rowset_accessor *accessor = this->accessors;
+			this->accessors = accessor->next;
+			CoTaskMemFree(accessor->bindings);
+			CoTaskMemFree(accessor);
+		}
+		SAFE_RELEASE(this->pIDataConvert);
+		oledb_release_conversion_options(this->conv);
+		CoTaskMemFree(this);
+		return 0;
+	}
+	return this->refcount;
+}
+
+/* IRowset */
+
+static HRESULT STDMETHODCALLTYPE IRowset_QueryInterface(IRowset *ptr,
+            /* [in] */ REFIID riid,
+            /* [iid_is][out] */ void **ppvObject)
+{
+	DECLARE_THIS(ptr, 0);
+	return zval_rowset_QueryInterface(this, riid, ppvObject);
+}
+
+static ULONG STDMETHODCALLTYPE IRowset_AddRef(IRowset *ptr)
+{
+	DECLARE_THIS(ptr, 0);
+	return zval_rowset_AddRef(this);
+}
+
+static ULONG STDMETHODCALLTYPE IRowset_Release(IRowset *ptr)
+{
+	DECLARE_THIS(ptr, 0);
+	return zval_rowset_Release(this);
+}
+
+static HRESULT STDMETHODCALLTYPE IRowset_AddRefRows(IRowset *ptr,
+			DBCOUNTITEM cRows,
+			const HROW rghRows[],
+			DBREFCOUNT rgRefCounts[],
+			DBROWSTATUS rgRowStatus[])
+{
+	DECLARE_THIS(ptr, 0);
+	DBCOUNTITEM i, errors = 0;
+
+	for (i = 0; i < cRows; i++) {
+		HROW hRow = rghRows[i];
+		if (hRow >= 1 && hRow <= this->row_count && this->rows[hRow - 1]) {
+			this->row_refcounts[hRow - 1]++;
+			if (rgRefCounts) rgRefCounts[i] = this->row_refcounts[hRow - 1];
+			if (rgRowStatus) rgRowStatus[i] = DBROWSTATUS_S_OK;
+		} else {
+			if (rgRefCounts) rgRefCounts[i] = 0;
+			if (rgRowStatus) rgRowStatus[i] = DBROWSTATUS_E_INVALID;
+			errors++;
+		}
+	}
+	if (errors) {
+		return (errors == cRows) ? DB_E_ERRORSOCCURRED : DB_S_ERRORSOCCURRED;
+	}
+	return S_OK;
+}
+
+static HRESULT STDMETHODCALLTYPE IRowset_GetData(IRowset *ptr,
+			HROW hRow,
+			HACCESSOR hAccessor,
+			void *pData)
+{
+	DECLARE_THIS(ptr, 0);
+	zval_rowset_accessor *accessor = zval_rowset_find_accessor(this, hAccessor);
+	DBCOUNTITEM i, errors = 0;
+	zval *row;
+
+	if (!accessor) {
+		return DB_E_BADACCESSORHANDLE;
+	}
+	if (hRow < 1 || hRow > this->row_count || !this->rows[hRow - 1]) {
+		return DB_E_BADROWHANDLE;
+	}
+	row = this->rows[hRow - 1];
+
+	for (i = 0; i < accessor->binding_count; i++) {
+		DBBINDING *binding = &accessor->bindings[i];
+		zval *value = zval_rowset_get_value(this, row, binding->iOrdinal);
+		DBSTATUS status = zval_rowset_get_column_data(this, value, binding, (BYTE *) pData);
+
+		if (status != DBSTATUS_S_OK && status != DBSTATUS_S_ISNULL) {
+			errors++;
+		}
+	}
+	if (errors) {
+		return (errors == accessor->binding_count) ? DB_E_ERRORSOCCURRED : DB_S_ERRORSOCCURRED;
+	}
+	return S_OK;
+}
+
+static HRESULT STDMETHODCALLTYPE IRowset_GetNextRows(IRowset *ptr,
+			HCHAPTER hReserved,
+			DBROWOFFSET lRowsOffset,
+			DBROWCOUNT cRows,
+			DBCOUNTITEM *pcRowsObtained,
+			HROW **prghRows)
+{
+	DECLARE_THIS(ptr, 0);
+	HRESULT hr = S_OK;
+	DBCOUNTITEM count = 0;
+	zval *row;
+
+	*pcRowsObtained = 0;
+	if (lRowsOffset < 0 || cRows < 0) {
+		return DB_E_CANTFETCHBACKWARDS;
+	}
+
+	/* the rowset can't hold rows--the previous batch is gone once the provider moves on */
+	zval_rowset_release_rows(this);
+
+	while (lRowsOffset-- > 0) {
+		hr = zval_rowset_fetch(this, &row);
+		if (hr != S_OK) {
+			return (hr == S_FALSE) ? DB_S_ENDOFROWSET : hr;
+		}
+		zval_ptr_dtor(&row);
+	}
+	if (cRows == 0) {
+		return S_OK;
+	}
+
+	this->rows = CoTaskMemRealloc(this->rows, cRows * sizeof(*this->rows));
+	this->row_refcounts = CoTaskMemRealloc(this->row_refcounts, cRows * sizeof(*this->row_refcounts));
+	while (count < (DBCOUNTITEM) cRows) {
+		hr = zval_rowset_fetch(this, &row);
+		if (hr != S_OK) break;
+		this->rows[count] = row;
+		this->row_refcounts[count] = 1;
+		this->row_count = ++count;
+	}
+	if (!SUCCEEDED(hr)) {
+		zval_rowset_release_rows(this);
+		return hr;
+	}
+
+	if (count > 0) {
+		DBCOUNTITEM i;
+		if (!*prghRows) {
+			*prghRows = CoTaskMemAlloc(count * sizeof(HROW));
+		}
+		for (i = 0; i < count; i++) {
+			(*prghRows)[i] = i + 1;
+		}
+	}
+	*pcRowsObtained = count;
+	return (count < (DBCOUNTITEM) cRows) ? DB_S_ENDOFROWSET : S_OK;
+}
+
+static HRESULT STDMETHODCALLTYPE IRowset_ReleaseRows(IRowset *ptr,
+			DBCOUNTITEM cRows,
+			const HROW rghRows[],
+			DBROWOPTIONS rgRowOptions[],
+			DBREFCOUNT rgRefCounts[],
+			DBROWSTATUS rgRowStatus[])
+{
+	DECLARE_THIS(ptr, 0);
+	void *tsrm_ls = this->tsrm_ls;
+	DBCOUNTITEM i, errors = 0;
+
+	for (i = 0; i < cRows; i++) {
+		HROW hRow = rghRows[i];
+		if (hRow >= 1 && hRow <= this->row_count && this->rows[hRow - 1]) {
+			if (--this->row_refcounts[hRow - 1] == 0) {
+				zval_ptr_dtor(&this->rows[hRow - 1]);
+				this->rows[hRow - 1] = NULL;
+			}
+			if (rgRefCounts) rgRefCounts[i] = this->row_refcounts[hRow - 1];
+			if (rgRowStatus) rgRowStatus[i] = DBROWSTATUS_S_OK;
+		} else {
+			if (rgRefCounts) rgRefCounts[i] = 0;
+			if (rgRowStatus) rgRowStatus[i] = DBROWSTATUS_E_INVALID;
+			errors++;
+		}
+	}
+	if (errors) {
+		return (errors == cRows) ? DB_E_ERRORSOCCURRED : DB_S_ERRORSOCCURRED;
+	}
+	return S_OK;
+}
+
+static HRESULT STDMETHODCALLTYPE IRowset_RestartPosition(IRowset *ptr,
+			HCHAPTER hReserved)
+{
+	DECLARE_THIS(ptr, 0);
+	void *tsrm_ls = this->tsrm_ls;
+
+	zval_rowset_release_rows(this);
+	if (this->pending) {
+		zval_ptr_dtor(&this->pending);
+		this->pending = NULL;
+	}
+	if (this->iterator) {
+		/* generators and the like can't go back */
+		if (this->iterator->funcs->rewind) {
+			this->iterator->funcs->rewind(this->iterator TSRMLS_CC);
+		}
+		this->advance = FALSE;
+		if (EG(exception)) {
+			return DB_E_CANNOTRESTART;
+		}
+	} else {
+		zend_hash_internal_pointer_reset_ex(Z_ARRVAL_P(this->source), &this->position);
+	}
+	return S_OK;
+}
+
+IRowsetVtbl zval_rowset_IRowset_Vtbl = {
+	IRowset_QueryInterface,
+	IRowset_AddRef,
+	IRowset_Release,
+	IRowset_AddRefRows,
+	IRowset_GetData,
+	IRowset_GetNextRows,
+	IRowset_ReleaseRows,
+	IRowset_RestartPosition,
+};
+
+/* IAccessor */
+
+static HRESULT STDMETHODCALLTYPE IAccessor_QueryInterface(IAccessor *ptr,
+            /* [in] */ REFIID riid,
+            /* [iid_is][out] */ void **ppvObject)
+{
+	DECLARE_THIS(ptr, 1);
+	return zval_rowset_QueryInterface(this, riid, ppvObject);
+}
+
+static ULONG STDMETHODCALLTYPE IAccessor_AddRef(IAccessor *ptr)
+{
+	DECLARE_THIS(ptr, 1);
+	return zval_rowset_AddRef(this);
+}
+
+static ULONG STDMETHODCALLTYPE IAccessor_Release(IAccessor *ptr)
+{
+	DECLARE_THIS(ptr, 1);
+	return zval_rowset_Release(this);
+}
+
+static HRESULT STDMETHODCALLTYPE IAccessor_AddRefAccessor(IAccessor *ptr,
+			HACCESSOR hAccessor,
+			DBREFCOUNT *pcRefCount)
+{
+	DECLARE_THIS(ptr, 1);
+	zval_rowset_accessor *accessor = zval_rowset_find_accessor(this, hAccessor);
+
+	if (!accessor) {
+		return DB_E_BADACCESSORHANDLE;
+	}
+	accessor->refcount++;
+	if (pcRefCount) *pcRefCount = accessor->refcount;
+	return S_OK;
+}
+
+static HRESULT STDMETHODCALLTYPE IAccessor_CreateAccessor(IAccessor *ptr,
+			DBACCESSORFLAGS dwAccessorFlags,
+			DBCOUNTITEM cBindings,
+			const DBBINDING rgBindings[],
+			DBLENGTH cbRowSize,
+			HACCESSOR *phAccessor,
+			DBBINDSTATUS rgStatus[])
+{
+	DECLARE_THIS(ptr, 1);
+	zval_rowset_accessor *accessor;
+	DBCOUNTITEM i, errors = 0;
+
+	*phAccessor = DB_NULL_HACCESSOR;
+	if (!(dwAccessorFlags & DBACCESSOR_ROWDATA) || (dwAccessorFlags & DBACCESSOR_PARAMETERDATA)) {
+		return DB_E_BADACCESSORFLAGS;
+	}
+	for (i = 0; i < cBindings; i++) {
+		DBBINDSTATUS status = DBBINDSTATUS_OK;
+		if (rgBindings[i].iOrdinal < 1 || rgBindings[i].iOrdinal > this->column_count) {
+			status = DBBINDSTATUS_BADORDINAL;
+		} else if (rgBindings[i].pObject) {
+			status = DBBINDSTATUS_UNSUPPORTEDCONVERSION;
+		}
+		if (status != DBBINDSTATUS_OK) {
+			errors++;
+		}
+		if (rgStatus) rgStatus[i] = status;
+	}
+	if (errors) {
+		return DB_E_ERRORSOCCURRED;
+	}
+
+	accessor = CoTaskMemAlloc(sizeof(*accessor));
+	accessor->flags = dwAccessorFlags;
+	accessor->binding_count = cBindings;
+	accessor->bindings = CoTaskMemAlloc(max(cBindings, 1) * sizeof(DBBINDING));
+	memcpy(accessor->bindings, rgBindings, cBindings * sizeof(DBBINDING));
+	accessor->refcount = 1;
+	accessor->next = this->accessors;
+	this->accessors = accessor;
+
+	*phAccessor = (HACCESSOR) accessor;
+	return S_OK;
+}
+
+static HRESULT STDMETHODCALLTYPE IAccessor_GetBindings(IAccessor *ptr,
+			HACCESSOR hAccessor,
+			DBACCESSORFLAGS *pdwAccessorFlags,
+			DBCOUNTITEM *pcBindings,
+			DBBINDING **prgBindings)
+{
+	DECLARE_THIS(ptr, 1);
+	zval_rowset_accessor *accessor = zval_rowset_find_accessor(this, hAccessor);
+
+	*pcBindings = 0;
+	*prgBindings = NULL;
+	if (!accessor) {
+		return DB_E_BADACCESSORHANDLE;
+	}
+	*pdwAccessorFlags = accessor->flags;
+	if (accessor->binding_count) {
+		*prgBindings = CoTaskMemAlloc(accessor->binding_count * sizeof(DBBINDING));
+		memcpy(*prgBindings, accessor->bindings, accessor->binding_count * sizeof(DBBINDING));
+	}
+	*pcBindings = accessor->binding_count;
+	return S_OK;
+}
+
+static HRESULT STDMETHODCALLTYPE IAccessor_ReleaseAccessor(IAccessor *ptr,
+			HACCESSOR hAccessor,
+			DBREFCOUNT *pcRefCount)
+{
+	DECLARE_THIS(ptr, 1);
+	zval_rowset_accessor **p;
+
+	for (p = &this->accessors; *p; p = &(*p)->next) {
+		zval_rowset_accessor *accessor = *p;
+		if ((HACCESSOR) accessor == hAccessor) {
+			if (pcRefCount) *pcRefCount = accessor->refcount - 1;
+			if (--accessor->refcount == 0) {
+				*p = accessor->next;
+				CoTaskMemFree(accessor->bindings);
+				CoTaskMemFree(accessor);
+			}
+			return S_OK;
+		}
+	}
+	return DB_E_BADACCESSORHANDLE;
+}
+
+IAccessorVtbl zval_rowset_IAccessor_Vtbl = {
+	IAccessor_QueryInterface,
+	IAccessor_AddRef,
+	IAccessor_Release,
+	IAccessor_AddRefAccessor,
+	IAccessor_CreateAccessor,
+	IAccessor_GetBindings,
+	IAccessor_ReleaseAccessor,
+};
+
+/* IColumnsInfo */
+
+static HRESULT STDMETHODCALLTYPE IColumnsInfo_QueryInterface(IColumnsInfo *ptr,
+            /* [in] */ REFIID riid,
+            /* [iid_is][out] */ void **ppvObject)
+{
+	DECLARE_THIS(ptr, 2);
+	return zval_rowset_QueryInterface(this, riid, ppvObject);
+}
+
+static ULONG STDMETHODCALLTYPE IColumnsInfo_AddRef(IColumnsInfo *ptr)
+{
+	DECLARE_THIS(ptr, 2);
+	return zval_rowset_AddRef(this);
+}
+
+static ULONG STDMETHODCALLTYPE IColumnsInfo_Release(IColumnsInfo *ptr)
+{
+	DECLARE_THIS(ptr, 2);
+	return zval_rowset_Release(this);
+}
+
+static HRESULT STDMETHODCALLTYPE IColumnsInfo_GetColumnInfo(IColumnsInfo *ptr,
+			DBORDINAL *pcColumns,
+			DBCOLUMNINFO **prgInfo,
+			OLECHAR **ppStringsBuffer)
+{
+	DECLARE_THIS(ptr, 2);
+	DBCOLUMNINFO *info;
+	OLECHAR *strings = NULL, *s;
+	UINT string_len = 0;
+	DBORDINAL i;
+
+	*pcColumns = 0;
+	*prgInfo = NULL;
+	*ppStringsBuffer = NULL;
+	if (!this->column_count) {
+		return S_OK;
+	}
+
+	for (i = 0; i < this->column_count; i++) {
+		if (this->columns[i].name) {
+			string_len += SysStringLen(this->columns[i].name) + 1;
+		}
+	}
+	if (string_len) {
+		strings = CoTaskMemAlloc(string_len * sizeof(OLECHAR));
+	}
+	info = CoTaskMemAlloc(this->column_count * sizeof(*info));
+	ZeroMemory(info, this->column_count * sizeof(*info));
+
+	for (i = 0, s = strings; i < this->column_count; i++) {
+		zval_rowset_column *column = &this->columns[i];
+		DBCOLUMNINFO *c = &info[i];
+
+		c->iOrdinal = i + 1;
+		c->wType = column->type;
+		c->dwFlags = DBCOLUMNFLAGS_MAYBENULL | DBCOLUMNFLAGS_ISNULLABLE;
+		c->bPrecision = ~0;
+		c->bScale = ~0;
+		switch (column->type) {
+			case DBTYPE_I8:
+				c->ulColumnSize = sizeof(LONGLONG);
+				c->bPrecision = 19;
+				break;
+			case DBTYPE_R8:
+				c->ulColumnSize = sizeof(double);
+				c->bPrecision = 15;
+				break;
+			case DBTYPE_BOOL:
+				c->ulColumnSize = sizeof(VARIANT_BOOL);
+				break;
+			case DBTYPE_DBTIMESTAMP:
+				c->ulColumnSize = sizeof(DBTIMESTAMP);
+				c->bPrecision = 23;
+				c->bScale = 3;
+				break;
+			default:
+				c->ulColumnSize = ~0;
+				c->dwFlags |= DBCOLUMNFLAGS_ISLONG;
+		}
+		if (c->ulColumnSize != ~0) {
+			c->dwFlags |= DBCOLUMNFLAGS_ISFIXEDLENGTH;
+		}
+		if (column->name) {
+			UINT len = SysStringLen(column->name);
+			memcpy(s, column->name, (len + 1) * sizeof(OLECHAR));
+			c->pwszName = s;
+			c->columnid.eKind = DBKIND_NAME;
+			c->columnid.uName.pwszName = s;
+			s += len + 1;
+		} else {
+			c->columnid.eKind = DBKIND_GUID_PROPID;
+			c->columnid.uName.ulPropid = i + 1;
+		}
+	}
+
+	*pcColumns = this->column_count;
+	*prgInfo = info;
+	*ppStringsBuffer = strings;
+	return S_OK;
+}
+
+static HRESULT STDMETHODCALLTYPE IColumnsInfo_MapColumnIDs(IColumnsInfo *ptr,
+			DBORDINAL cColumnIDs,
+			const DBID rgColumnIDs[],
+			DBORDINAL rgColumns[])
+{
+	DECLARE_THIS(ptr, 2);
+	DBORDINAL i, j, errors = 0;
+
+	for (i = 0; i < cColumnIDs; i++) {
+		const DBID *id = &rgColumnIDs[i];
+		rgColumns[i] = DB_INVALIDCOLUMN;
+		if (id->eKind == DBKIND_NAME && id->uName.pwszName) {
+			for (j = 0; j < this->column_count; j++) {
+				if (this->columns[j].name && _wcsicmp(this->columns[j].name, id->uName.pwszName) == 0) {
+					rgColumns[i] = j + 1;
+					break;
+				}
+			}
+		} else if (id->eKind == DBKIND_GUID_PROPID && id->uName.ulPropid >= 1 && id->uName.ulPropid <= this->column_count) {
+			rgColumns[i] = id->uName.ulPropid;
+		}
+		if (rgColumns[i] == DB_INVALIDCOLUMN) {
+			errors++;
+		}
+	}
+	if (errors) {
+		return (errors == cColumnIDs) ? DB_E_ERRORSOCCURRED : DB_S_ERRORSOCCURRED;
+	}
+	return S_OK;
+}
+
+IColumnsInfoVtbl zval_rowset_IColumnsInfo_Vtbl = {
+	IColumnsInfo_QueryInterface,
+	IColumnsInfo_AddRef,
+	IColumnsInfo_Release,
+	IColumnsInfo_GetColumnInfo,
+	IColumnsInfo_MapColumnIDs,
+};
+
+/* IRowsetInfo */
+
+static HRESULT STDMETHODCALLTYPE IRowsetInfo_QueryInterface(IRowsetInfo *ptr,
+            /* [in] */ REFIID riid,
+            /* [iid_is][out] */ void **ppvObject)
+{
+	DECLARE_THIS(ptr, 3);
+	return zval_rowset_QueryInterface(this, riid, ppvObject);
+}
+
+static ULONG STDMETHODCALLTYPE IRowsetInfo_AddRef(IRowsetInfo *ptr)
+{
+	DECLARE_THIS(ptr, 3);
+	return zval_rowset_AddRef(this);
+}
+
+static ULONG STDMETHODCALLTYPE IRowsetInfo_Release(IRowsetInfo *ptr)
+{
+	DECLARE_THIS(ptr, 3);
+	return zval_rowset_Release(this);
+}
+
+static BOOL zval_rowset_get_property(DBPROPID id, VARIANT_BOOL *pValue)
+{
+	switch (id) {
+		case DBPROP_IRowset:
+		case DBPROP_IAccessor:
+		case DBPROP_IColumnsInfo:
+		case DBPROP_IRowsetInfo:
+			*pValue = VARIANT_TRUE;
+			return TRUE;
+		case DBPROP_CANHOLDROWS:
+		case DBPROP_CANFETCHBACKWARDS:
+		case DBPROP_CANSCROLLBACKWARDS:
+		case DBPROP_BOOKMARKS:
+			*pValue = VARIANT_FALSE;
+			return TRUE;
+	}
+	return FALSE;
+}
+
+static HRESULT STDMETHODCALLTYPE IRowsetInfo_GetProperties(IRowsetInfo *ptr,
+			const ULONG cPropertyIDSets,
+			const DBPROPIDSET rgPropertyIDSets[],
+			ULONG *pcPropertySets,
+			DBPROPSET **prgPropertySets)
+{
+	DECLARE_THIS(ptr, 3);
+	DBPROPSET *sets;
+	ULONG i, j, found = 0, missing = 0;
+
+	*pcPropertySets = 0;
+	*prgPropertySets = NULL;
+	if (!cPropertyIDSets) {
+		return S_OK;
+	}
+
+	sets = CoTaskMemAlloc(cPropertyIDSets * sizeof(*sets));
+	for (i = 0; i < cPropertyIDSets; i++) {
+		const DBPROPIDSET *id_set = &rgPropertyIDSets[i];
+		DBPROPSET *set = &sets[i];
+
+		set->guidPropertySet = id_set->guidPropertySet;
+		set->cProperties = id_set->cPropertyIDs;
+		set->rgProperties = NULL;
+		if (id_set->cPropertyIDs) {
+			set->rgProperties = CoTaskMemAlloc(id_set->cPropertyIDs * sizeof(DBPROP));
+			ZeroMemory(set->rgProperties, id_set->cPropertyIDs * sizeof(DBPROP));
+		}
+		for (j = 0; j < id_set->cPropertyIDs; j++) {
+			DBPROP *prop = &set->rgProperties[j];
+			VARIANT_BOOL value;
+
+			prop->dwPropertyID = id_set->rgPropertyIDs[j];
+			VariantInit(&prop->vValue);
+			if (IsEqualGUID(&id_set->guidPropertySet, &DBPROPSET_ROWSET) && zval_rowset_get_property(prop->dwPropertyID, &value)) {
+				prop->dwStatus = DBPROPSTATUS_OK;
+				V_VT(&prop->vValue) = VT_BOOL;
+				V_BOOL(&prop->vValue) = value;
+				found++;
+			} else {
+				prop->dwStatus = DBPROPSTATUS_NOTSUPPORTED;
+				missing++;
+			}
+		}
+	}
+
+	*pcPropertySets = cPropertyIDSets;
+	*prgPropertySets = sets;
+	if (missing) {
+		return (found) ? DB_S_ERRORSOCCURRED : DB_E_ERRORSOCCURRED;
+	}
+	return S_OK;
+}
+
+static HRESULT STDMETHODCALLTYPE IRowsetInfo_GetReferencedRowset(IRowsetInfo *ptr,
+			DBORDINAL iOrdinal,
+			REFIID riid,
+			IUnknown **ppReferencedRowset)
+{
+	DECLARE_THIS(ptr, 3);
+	*ppReferencedRowset = NULL;
+	return DB_E_NOTAREFERENCECOLUMN;
+}
+
+static HRESULT STDMETHODCALLTYPE IRowsetInfo_GetSpecification(IRowsetInfo *ptr,
+			REFIID riid,
+			IUnknown **ppSpecification)
+{
+	DECLARE_THIS(ptr, 3);
+	*ppSpecification = NULL;
+	return S_FALSE;
+}
+
+IRowsetInfoVtbl zval_rowset_IRowsetInfo_Vtbl = {
+	IRowsetInfo_QueryInterface,
+	IRowsetInfo_AddRef,
+	IRowsetInfo_Release,
+	IRowsetInfo_GetProperties,
+	IRowsetInfo_GetReferencedRowset,
+	IRowsetInfo_GetSpecification,
+};
+
+HRESULT oledb_create_zval_rowset(pdo_oledb_conversion *conv, zval *value, IUnknown **pUnk TSRMLS_DC)
+{
+	zval_rowset *this;
+	HRESULT hr = S_OK;
+	zend_class_entry *ce = (Z_TYPE_P(value) == IS_OBJECT) ? Z_OBJCE_P(value) : NULL;
+
+	*pUnk = NULL;
+	if (Z_TYPE_P(value) != IS_ARRAY && !(ce && ce->get_iterator)) {
+		oledb_set_automation_error(L"Expected an array or a Traversable object", L"HY105");
+		return E_INVALIDARG;
+	}
+
+	this = CoTaskMemAlloc(sizeof(*this));
+	ZeroMemory(this, sizeof(*this));
+	this->lpIRowsetVtbl = &zval_rowset_IRowset_Vtbl;
+	this->lpIAccessorVtbl = &zval_rowset_IAccessor_Vtbl;
+	this->lpIColumnsInfoVtbl = &zval_rowset_IColumnsInfo_Vtbl;
+	this->lpIRowsetInfoVtbl = &zval_rowset_IRowsetInfo_Vtbl;
+#ifdef ZTS
+	this->tsrm_ls = tsrm_ls;
+#else
+	this->tsrm_ls = NULL;
+#endif
+	this->refcount = 1;
+	this->source = value;
+	Z_ADDREF_P(value);
+	oledb_copy_conversion_options(&this->conv, conv);
+
+	if (ce) {
+		this->iterator = ce->get_iterator(ce, value, FALSE TSRMLS_CC);
+		if (this->iterator && !EG(exception) && this->iterator->funcs->rewind) {
+			this->iterator->funcs->rewind(this->iterator TSRMLS_CC);
+		}
+		if (!this->iterator || EG(exception)) {
+			oledb_set_automation_error(L"Unable to iterate through table rows", L"HY000");
+			hr = E_FAIL;
+			goto cleanup;
+		}
+	} else {
+		zend_hash_internal_pointer_reset_ex(Z_ARRVAL_P(value), &this->position);
+	}
+
+	/* values are converted to whatever types the provider wants */
+	hr = CoCreateInstance(&CLSID_OLEDB_CONVERSIONLIBRARY, NULL, CLSCTX_INPROC_SERVER, &IID_IDataConvert, (void **) &this->pIDataConvert);
+	if (!SUCCEEDED(hr)) goto cleanup;
+
+	/* look at the first row to see what the columns are--an empty table has none */
+	hr = zval_rowset_fetch(this, &this->pending);
+	if (hr == S_OK) {
+		hr = zval_rowset_describe_columns(this, this->pending);
+	}
+	if (SUCCEEDED(hr)) {
+		QUERY_INTERFACE((IUnknown *) this, IID_IUnknown, *pUnk);
+	}
+
+cleanup:
+	zval_rowset_Release(this);
+	return hr;
+}
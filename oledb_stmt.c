@@ -27,12 +27,20 @@
 #include "pdo/php_pdo_driver.h"
 #include "php_pdo_oledb.h"
 #include "php_pdo_oledb_int.h"
+#include "zend_interfaces.h"
 
 static void oledb_stmt_clear_rowset(pdo_stmt_t *stmt TSRMLS_DC)
 {
 	pdo_oledb_stmt *S = (pdo_oledb_stmt*)stmt->driver_data;
 	int i;
 
+	if (S->pIDBAsynchStatus) {
+		/* stop whatever the provider is still doing */
+		CALL(Abort, S->pIDBAsynchStatus, DB_NULL_HCHAPTER, DBASYNCHOP_OPEN);
+		RELEASE(S->pIDBAsynchStatus);
+		S->pIDBAsynchStatus = NULL;
+		S->flags &= ~(ASYNC_PENDING | ASYNC_DESCRIBE);
+	}
 	if (S->hRow) {
 		HROW *hRows = &S->hRow;
 		CALL(ReleaseRows, S->pIRowset, 1, hRows, NULL, NULL, NULL);
@@ -74,21 +82,81 @@ static void oledb_stmt_clear_rowset(pdo_stmt_t *stmt TSRMLS_DC)
 	S->rowIndex = 0;
 }
 
+static void oledb_stmt_swap_commands(pdo_oledb_stmt *S)
+{
+	ICommand *pICommand = S->pICommand;
+	ICommandWithParameters *pICommandWithParameters = S->pICommandWithParameters;
+	IAccessor *pIAccessorCommand = S->pIAccessorCommand;
+	HACCESSOR hAccessorCommand = S->hAccessorCommand;
+	DBBINDING *commandBindings = S->commandBindings;
+	DBCOUNTITEM commandBindingCount = S->commandBindingCount;
+	DBLENGTH commandRowSize = S->commandRowSize;
+
+	S->pICommand = S->pICommandAlt;
+	S->pICommandWithParameters = S->pICommandWithParametersAlt;
+	S->pIAccessorCommand = S->pIAccessorCommandAlt;
+	S->hAccessorCommand = S->hAccessorCommandAlt;
+	S->commandBindings = S->commandBindingsAlt;
+	S->commandBindingCount = S->commandBindingCountAlt;
+	S->commandRowSize = S->commandRowSizeAlt;
+
+	S->pICommandAlt = pICommand;
+	S->pICommandWithParametersAlt = pICommandWithParameters;
+	S->pIAccessorCommandAlt = pIAccessorCommand;
+	S->hAccessorCommandAlt = hAccessorCommand;
+	S->commandBindingsAlt = commandBindings;
+	S->commandBindingCountAlt = commandBindingCount;
+	S->commandRowSizeAlt = commandRowSize;
+	S->onReadSession = !S->onReadSession;
+}
+
+static void oledb_stmt_release_alt_command(pdo_oledb_stmt *S)
+{
+	if (S->pIAccessorCommandAlt) {
+		if (S->hAccessorCommandAlt) {
+			CALL(ReleaseAccessor, S->pIAccessorCommandAlt, S->hAccessorCommandAlt, NULL);
+		}
+		RELEASE(S->pIAccessorCommandAlt);
+	}
+	SAFE_EFREE(S->commandBindingsAlt);
+	SAFE_RELEASE(S->pICommandAlt);
+	SAFE_RELEASE(S->pICommandWithParametersAlt);
+	S->pIAccessorCommandAlt = NULL;
+	S->hAccessorCommandAlt = 0;
+	S->commandBindingsAlt = NULL;
+	S->commandBindingCountAlt = 0;
+	S->commandRowSizeAlt = 0;
+	S->pICommandAlt = NULL;
+	S->pICommandWithParametersAlt = NULL;
+}
+
 static int oledb_stmt_dtor(pdo_stmt_t *stmt TSRMLS_DC)
 {
 	pdo_oledb_stmt *S = (pdo_oledb_stmt*)stmt->driver_data;
 	oledb_stmt_clear_rowset(stmt TSRMLS_CC);
 	SAFE_RELEASE(S->pIMultipleResults);
-	SAFE_RELEASE(S->pICommand);
-	SAFE_RELEASE(S->pICommandWithParameters);
-	CoTaskMemFree(S->paramInfo);
-	CoTaskMemFree(S->paramNamesBuffer);
+	if (S->onReadSession) {
+		/* the statement cache holds commands of the primary session */
+		oledb_stmt_swap_commands(S);
+	}
+	oledb_stmt_release_alt_command(S);
+	if ((S->flags & CACHED_COMMAND) && !(S->flags & (COMMAND_PROPERTY_FLAGS | PREPARE_PENDING))) {
+		/* put the prepared command back, minus the parameter types set by the last execute */
+		CALL(SetParameterInfo, S->pICommandWithParameters, 0, NULL, NULL);
+		oledb_return_cached_command(S->H->cache, S);
+	}
 	if (S->pIAccessorCommand) {
 		if(S->hAccessorCommand) {
 			CALL(ReleaseAccessor, S->pIAccessorCommand, S->hAccessorCommand, NULL);
 		}
 		RELEASE(S->pIAccessorCommand);
 	}
+	SAFE_EFREE(S->commandBindings);
+	SAFE_RELEASE(S->pICommand);
+	SAFE_RELEASE(S->pICommandWithParameters);
+	CoTaskMemFree(S->paramInfo);
+	CoTaskMemFree(S->paramNamesBuffer);
+	SAFE_EFREE(S->cacheKey);
 	SAFE_EFREE(S->inputBuffer);
 	SAFE_EFREE(S->outputBuffer);
 	if (S->einfo.errmsg) {
@@ -602,6 +670,101 @@ static BOOL oledb_stmt_is_variable_width_column(DWORD type) {
 	return FALSE;
 }
 
+static BOOL oledb_stmt_parse_bigint(const char *s, int len, LONGLONG *pValue) {
+	char buffer[24];
+	int i = 0, start;
+
+	/* accept only plain integer literals that fit in 64 bits */
+	if (len > 0 && (s[0] == '-' || s[0] == '+')) {
+		i++;
+	}
+	start = i;
+	if (i == len || len - i > 19) {
+		return FALSE;
+	}
+	for (; i < len; i++) {
+		if (s[i] < '0' || s[i] > '9') {
+			return FALSE;
+		}
+	}
+	if (len - start == 19 && memcmp(s + start, (s[0] == '-') ? "9223372036854775808" : "9223372036854775807", 19) > 0) {
+		return FALSE;
+	}
+	memcpy(buffer, s, len);
+	buffer[len] = '\0';
+	*pValue = _strtoi64(buffer, NULL, 10);
+	return TRUE;
+}
+
+zend_class_entry *oledb_get_datetime_ce(TSRMLS_D) {
+	zend_class_entry **pce;
+
+	/* DateTimeInterface (which covers DateTimeImmutable too) is only there since PHP 5.5 */
+	if (zend_hash_find(EG(class_table), "datetimeinterface", sizeof("datetimeinterface"), (void **) &pce) == SUCCESS
+	 || zend_hash_find(EG(class_table), "datetime", sizeof("datetime"), (void **) &pce) == SUCCESS) {
+		return *pce;
+	}
+	return NULL;
+}
+
+HRESULT oledb_get_timestamp(zval *value, DBTIMESTAMP *ts TSRMLS_DC) {
+	HRESULT hr = E_FAIL;
+	zend_class_entry *ce = oledb_get_datetime_ce(TSRMLS_C);
+
+	if (ce && Z_TYPE_P(value) == IS_OBJECT && instanceof_function(Z_OBJCE_P(value), ce TSRMLS_CC)) {
+		zval method, format, result, *params[1];
+		int year, month, day, hour, minute, second, usec;
+
+		INIT_ZVAL(method);
+		INIT_ZVAL(format);
+		INIT_ZVAL(result);
+		ZVAL_STRINGL(&method, "format", sizeof("format") - 1, 0);
+		ZVAL_STRINGL(&format, "Y-m-d H:i:s.u", sizeof("Y-m-d H:i:s.u") - 1, 0);
+		params[0] = &format;
+
+		/* let the object render itself in its own time zone */
+		if (call_user_function(NULL, &value, &method, &result, 1, params TSRMLS_CC) == SUCCESS) {
+			if (Z_TYPE(result) == IS_STRING
+			 && sscanf(Z_STRVAL(result), "%d-%d-%d %d:%d:%d.%d", &year, &month, &day, &hour, &minute, &second, &usec) == 7) {
+				ts->year = (SHORT) year;
+				ts->month = (USHORT) month;
+				ts->day = (USHORT) day;
+				ts->hour = (USHORT) hour;
+				ts->minute = (USHORT) minute;
+				ts->second = (USHORT) second;
+				ts->fraction = (ULONG) usec * 1000;
+				hr = S_OK;
+			}
+			zval_dtor(&result);
+		}
+	}
+	if (!SUCCEEDED(hr)) {
+		oledb_set_automation_error(L"Expected a DateTime object", L"HY105");
+	}
+	return hr;
+}
+
+static void oledb_stmt_bind_integer(pdo_oledb_param *P, LONGLONG n, DBTYPE declaredType)
+{
+	if (declaredType == DBTYPE_I8 || n < INT_MIN || n > INT_MAX) {
+		/* a bigint parameter or a value that doesn't fit in 32 bits */
+		P->dataType = L"DBTYPE_I8";
+		P->dataTypeWidth = 8;
+		P->retrievalType = DBTYPE_I8;
+		P->bigintValue = n;
+		P->dataPointer = &P->bigintValue;
+		P->byteCount = sizeof(LONGLONG);
+	} else {
+		P->dataType = L"DBTYPE_I4";
+		P->dataTypeWidth = 4;
+		P->retrievalType = DBTYPE_I4;
+		P->intValue = (int) n;
+		P->dataPointer = &P->intValue;
+		P->byteCount = sizeof(int);
+	}
+	P->flags &= ~VARIABLE_LENGTH;
+}
+
 static HRESULT oledb_stmt_bind_param(pdo_stmt_t *stmt, struct pdo_bound_param_data *param TSRMLS_DC)
 {
 	pdo_oledb_stmt *S = (pdo_oledb_stmt*)stmt->driver_data;
@@ -611,6 +774,7 @@ static HRESULT oledb_stmt_bind_param(pdo_stmt_t *stmt, struct pdo_bound_param_da
 
 	HRESULT hr = S_OK;
 	DBPARAMINFO param_info;
+	LONGLONG bigint;
 	
 	if (S->paramInfo && param->paramno >= 0 && param->paramno < (int) S->paramCount) {
 		/* we know something about the parameter */
@@ -644,7 +808,27 @@ static HRESULT oledb_stmt_bind_param(pdo_stmt_t *stmt, struct pdo_bound_param_da
 	/* see if param is in or out */
 	if (param_info.dwFlags & DBPARAMFLAGS_ISINPUT) {
 		/* set the data type based on what's actually in the zval */
-		if (Z_TYPE_P(value) == IS_STRING) {
+		if (PDO_PARAM_TYPE(param->param_type) == PDO_OLEDB_PARAM_TABLE) {
+			/* rows are pulled from the array or iterator as the provider sends them */
+			hr = oledb_create_zval_rowset(P->conv, value, &P->stream TSRMLS_CC);
+			if (hr == S_FALSE) {
+				/* an empty table is sent as the default value */
+				P->flags |= EMPTY_TABLE;
+			} else {
+				P->flags &= ~EMPTY_TABLE;
+			}
+			P->dataType = L"table";
+			P->dataTypeWidth = ~0;
+			P->retrievalType = DBTYPE_TABLE;
+			P->dataPointer = &P->stream;
+			P->byteCount = sizeof(IUnknown *);
+			P->flags &= ~VARIABLE_LENGTH;
+		} else if (Z_TYPE_P(value) == IS_STRING
+		 && (PDO_PARAM_TYPE(param->param_type) == PDO_PARAM_INT || param_info.wType == DBTYPE_I8)
+		 && oledb_stmt_parse_bigint(Z_STRVAL_P(value), Z_STRLEN_P(value), &bigint)) {
+			/* 32-bit PHP hands us bigint keys as strings--don't make the server parse them */
+			oledb_stmt_bind_integer(P, bigint, param_info.wType);
+		} else if (Z_TYPE_P(value) == IS_STRING) {
 			P->flags |= VARIABLE_LENGTH;
 			if (P->flags & STRING_AS_UNICODE) {
 				if (param_info.dwFlags & DBPARAMFLAGS_ISLONG) {
@@ -725,13 +909,11 @@ static HRESULT oledb_stmt_bind_param(pdo_stmt_t *stmt, struct pdo_bound_param_da
 				hr = oledb_create_zval_stream(P->conv, value, (P->flags & STRING_AS_LOB) ? -1 : CONVERT_FROM_INPUT_TO_VARCHAR, &P->stream, &P->dataLength TSRMLS_CC);
 			}
 		} else if (Z_TYPE_P(value) == IS_LONG) {
-			P->dataType = L"DBTYPE_I4";
-			P->dataTypeWidth = 4;
-			P->retrievalType = DBTYPE_I4;
-			P->intValue = Z_LVAL_P(value);
-			P->dataPointer = &P->intValue;
-			P->byteCount = sizeof(int);
-			P->flags &= ~VARIABLE_LENGTH;
+			oledb_stmt_bind_integer(P, Z_LVAL_P(value), param_info.wType);
+		} else if (Z_TYPE_P(value) == IS_DOUBLE && param_info.wType == DBTYPE_I8
+				&& Z_DVAL_P(value) == floor(Z_DVAL_P(value)) && fabs(Z_DVAL_P(value)) < 9.2233720368547758e18) {
+			/* integer that overflowed into a double */
+			oledb_stmt_bind_integer(P, (LONGLONG) Z_DVAL_P(value), param_info.wType);
 		} else if (Z_TYPE_P(value) == IS_BOOL) {
 			P->dataType = L"DBTYPE_BOOL";
 			P->dataTypeWidth = 4;
@@ -748,6 +930,20 @@ static HRESULT oledb_stmt_bind_param(pdo_stmt_t *stmt, struct pdo_bound_param_da
 			P->dataPointer = &P->doubleValue;
 			P->byteCount = sizeof(double);
 			P->flags &= ~VARIABLE_LENGTH;
+		} else if (Z_TYPE_P(value) == IS_OBJECT && PDO_PARAM_TYPE(param->param_type) == PDO_OLEDB_PARAM_DATETIME) {
+			/* send dates in binary form instead of having the server parse a string */
+			hr = oledb_get_timestamp(value, &P->timestampValue TSRMLS_CC);
+			P->dataType = L"DBTYPE_DBTIMESTAMP";
+			P->dataTypeWidth = sizeof(DBTIMESTAMP);
+			P->retrievalType = DBTYPE_DBTIMESTAMP;
+			P->dataPointer = &P->timestampValue;
+			P->byteCount = sizeof(DBTIMESTAMP);
+			P->flags &= ~VARIABLE_LENGTH;
+			if (!param_info.bPrecision) {
+				/* datetime: yyyy-mm-dd hh:mm:ss.fff */
+				param_info.bPrecision = 23;
+				param_info.bScale = 3;
+			}
 		} else if (Z_TYPE_P(value) == IS_NULL) {
 			if (!(param_info.dwFlags & DBPARAMFLAGS_ISINPUT)) {
 				// set to empty string if it isn't an output param
@@ -763,6 +959,39 @@ static HRESULT oledb_stmt_bind_param(pdo_stmt_t *stmt, struct pdo_bound_param_da
 		P->ioFlags |= DBPARAMIO_INPUT;
 	}
 	if (param_info.dwFlags & DBPARAMFLAGS_ISOUTPUT) {
+		if (!P->dataType && PDO_PARAM_TYPE(param->param_type) != PDO_PARAM_LOB) {
+			/* retrieve these in their native form if the provider told us the type */
+			switch (param_info.wType) {
+				case DBTYPE_I8:
+					P->dataType = L"DBTYPE_I8";
+					P->dataTypeWidth = 8;
+					P->retrievalType = DBTYPE_I8;
+					P->byteCount = sizeof(LONGLONG);
+				break;
+				case DBTYPE_R4:
+				case DBTYPE_R8:
+					P->dataType = (param_info.wType == DBTYPE_R4) ? L"DBTYPE_R4" : L"DBTYPE_R8";
+					P->dataTypeWidth = (param_info.wType == DBTYPE_R4) ? 4 : 8;
+					P->retrievalType = DBTYPE_R8;
+					P->byteCount = sizeof(double);
+				break;
+				case DBTYPE_DBTIMESTAMP:
+					P->dataType = L"DBTYPE_DBTIMESTAMP";
+					P->dataTypeWidth = sizeof(DBTIMESTAMP);
+					P->retrievalType = DBTYPE_DBTIMESTAMP;
+					P->byteCount = sizeof(DBTIMESTAMP);
+				break;
+				case DBTYPE_GUID:
+					P->dataType = L"DBTYPE_GUID";
+					P->dataTypeWidth = sizeof(GUID);
+					P->retrievalType = DBTYPE_GUID;
+					P->byteCount = sizeof(GUID);
+				break;
+			}
+			if (P->dataType) {
+				P->flags &= ~VARIABLE_LENGTH;
+			}
+		}
 		if (!P->dataType) {
 			/* don't know what the param should be yet */
 			if (PDO_PARAM_TYPE(param->param_type) == PDO_PARAM_STR) {
@@ -849,12 +1078,17 @@ static HRESULT oledb_stmt_copy_bound_params(pdo_stmt_t *stmt, DBPARAMS *params T
 	DBBINDSTATUS *bind_statuses = NULL;
 	DBORDINAL param_count = ht->nNumOfElements;
 	DBORDINAL i = 0;
+	static DBOBJECT table_object;
 
 	bindings = ecalloc(param_count, sizeof(*bindings));
 	bind_statuses = ecalloc(param_count, sizeof(*bind_statuses));
 
 	S->nextInputOffset = 0;
 
+	/* table-valued parameters are passed as rowsets (static so the bindings compare equal from one execute to the next) */
+	table_object.dwFlags = STGM_READ;
+	table_object.iid = IID_IRowset;
+
 	zend_hash_internal_pointer_reset(ht);
 	while (SUCCESS == zend_hash_get_current_data(ht, (void**)&param)) {
 		pdo_oledb_param *P = (pdo_oledb_param*)param->driver_data;
@@ -867,6 +1101,9 @@ static HRESULT oledb_stmt_copy_bound_params(pdo_stmt_t *stmt, DBPARAMS *params T
 		if (P->retrievalType & DBTYPE_BYREF) {
 			bindings[i].dwMemOwner = DBMEMOWNER_PROVIDEROWNED;
 		}
+		if (P->retrievalType == DBTYPE_TABLE) {
+			bindings[i].pObject = &table_object;
+		}
 
 		/* space for the column status */
 		bindings[i].dwPart = DBPART_STATUS;
@@ -890,8 +1127,27 @@ static HRESULT oledb_stmt_copy_bound_params(pdo_stmt_t *stmt, DBPARAMS *params T
 		zend_hash_move_forward(ht);
 	}
 
-	hr = CALL(CreateAccessor, S->pIAccessorCommand, DBACCESSOR_PARAMETERDATA, i, bindings, S->nextInputOffset, &S->hAccessorCommand, bind_statuses);
-	if (!SUCCEEDED(hr)) goto cleanup;
+	if (S->hAccessorCommand && S->commandBindingCount == i && S->commandRowSize == S->nextInputOffset
+	 && memcmp(S->commandBindings, bindings, i * sizeof(*bindings)) == 0) {
+		/* same layout as last time--the accessor can be used again */
+	} else {
+		if (S->hAccessorCommand) {
+			CALL(ReleaseAccessor, S->pIAccessorCommand, S->hAccessorCommand, NULL);
+			S->hAccessorCommand = 0;
+		}
+		SAFE_EFREE(S->commandBindings);
+		S->commandBindings = NULL;
+		S->commandBindingCount = 0;
+
+		hr = CALL(CreateAccessor, S->pIAccessorCommand, DBACCESSOR_PARAMETERDATA, i, bindings, S->nextInputOffset, &S->hAccessorCommand, bind_statuses);
+		if (!SUCCEEDED(hr)) goto cleanup;
+
+		/* remember the layout so the accessor can be reused */
+		S->commandBindings = bindings;
+		S->commandBindingCount = i;
+		S->commandRowSize = S->nextInputOffset;
+		bindings = NULL;
+	}
 
 	/* alloc a buffer large enough and copy the data into it */
 	S->inputBuffer = erealloc(S->inputBuffer, S->nextInputOffset);
@@ -906,7 +1162,7 @@ static HRESULT oledb_stmt_copy_bound_params(pdo_stmt_t *stmt, DBPARAMS *params T
 			DWORD *pStatus = (DWORD *) pBuffer;
 
 			if (P->byteCount) {
-				*pStatus = DBSTATUS_S_OK;
+				*pStatus = (P->flags & EMPTY_TABLE) ? DBSTATUS_S_DEFAULT : DBSTATUS_S_OK;
 				if (P->flags & VARIABLE_LENGTH) {
 					pLength = (DBLENGTH *) (pBuffer + sizeof(DWORD));
 					*pLength = P->dataLength;
@@ -969,6 +1225,8 @@ static HRESULT oledb_stmt_sync_output_params(pdo_stmt_t *stmt TSRMLS_DC)
 				DBLENGTH *pLength = NULL;
 				unsigned int len;
 				int conversion;
+				WCHAR guid_w[39];
+				char guid[36];
 
 				if (P->flags & VARIABLE_LENGTH) {
 					pLength = (DBLENGTH *) (pBuffer + sizeof(DWORD));
@@ -1009,9 +1267,30 @@ static HRESULT oledb_stmt_sync_output_params(pdo_stmt_t *stmt TSRMLS_DC)
 					case DBTYPE_I4:
 						ZVAL_LONG(param->parameter, *((long *) pValue));
 					break;
+					case DBTYPE_I8:
+						if (*((LONGLONG *) pValue) >= LONG_MIN && *((LONGLONG *) pValue) <= LONG_MAX) {
+							ZVAL_LONG(param->parameter, (long) *((LONGLONG *) pValue));
+						} else {
+							/* too big for a PHP integer */
+							char buffer[24];
+							_i64toa(*((LONGLONG *) pValue), buffer, 10);
+							ZVAL_STRING(param->parameter, buffer, TRUE);
+						}
+					break;
 					case DBTYPE_R8:
 						ZVAL_DOUBLE(param->parameter, *((double *) pValue));
 					break;
+					case DBTYPE_DBTIMESTAMP:
+						ZVAL_STRING(param->parameter, oledb_datetime_to_str((DBTIMESTAMP *) pValue), FALSE);
+					break;
+					case DBTYPE_GUID:
+						/* same format as uniqueidentifier columns, minus the braces */
+						StringFromGUID2((GUID *) pValue, guid_w, sizeof(guid_w) / sizeof(guid_w[0]));
+						for (len = 0; len < sizeof(guid); len++) {
+							guid[len] = (char) guid_w[len + 1];
+						}
+						ZVAL_STRINGL(param->parameter, guid, sizeof(guid), TRUE);
+					break;
 				}
 			}
 		}
@@ -1020,6 +1299,314 @@ static HRESULT oledb_stmt_sync_output_params(pdo_stmt_t *stmt TSRMLS_DC)
 	return hr;
 }
 
+static HRESULT oledb_stmt_select_session(pdo_stmt_t *stmt TSRMLS_DC)
+{
+	pdo_oledb_stmt *S = (pdo_oledb_stmt*)stmt->driver_data;
+	pdo_oledb_db_handle *H = S->H;
+	ICommandText *pICommandText = NULL, *pICommandTextAlt = NULL;
+	LPOLESTR text = NULL;
+	GUID dialect = DBGUID_DEFAULT;
+	BOOL read = FALSE;
+	HRESULT hr = S_OK;
+
+	/* decided on every execute--once a transaction starts, everything runs on the primary */
+	if (H->readHost && !stmt->dbh->in_txn && (S->readOnly || (H->routeSelects && S->plainSelect))) {
+		read = SUCCEEDED(oledb_open_read_session(stmt->dbh TSRMLS_CC));
+	}
+	if (read == S->onReadSession) {
+		return S_OK;
+	}
+
+	if (!S->pICommandAlt) {
+		IDBCreateCommand *pIDBCreateCommand = (read) ? H->pIDBCreateCommandRead : H->pIDBCreateCommand;
+		hr = CALL(CreateCommand, pIDBCreateCommand, NULL, &IID_ICommand, (IUnknown **) &S->pICommandAlt);
+		if (!SUCCEEDED(hr)) goto cleanup;
+
+		/* the text is set on every execute if PDO does the placeholders */
+		if (stmt->supports_placeholders != PDO_PLACEHOLDER_NONE) {
+			QUERY_INTERFACE(S->pICommand, IID_ICommandText, pICommandText);
+			QUERY_INTERFACE(S->pICommandAlt, IID_ICommandText, pICommandTextAlt);
+			if (!pICommandText || !pICommandTextAlt) {
+				hr = E_NOINTERFACE;
+				goto cleanup;
+			}
+
+			hr = CALL(GetCommandText, pICommandText, &dialect, &text);
+			if (!SUCCEEDED(hr)) goto cleanup;
+			hr = CALL(SetCommandText, pICommandTextAlt, &dialect, text);
+			if (!SUCCEEDED(hr)) goto cleanup;
+
+			QUERY_INTERFACE(S->pICommandAlt, IID_ICommandWithParameters, S->pICommandWithParametersAlt);
+			if (S->pICommandWithParametersAlt) {
+				QUERY_INTERFACE(S->pICommandWithParametersAlt, IID_IAccessor, S->pIAccessorCommandAlt);
+			}
+		}
+	}
+	oledb_stmt_swap_commands(S);
+
+	if (S->pICommandWithParameters && stmt->bound_params) {
+		/* the parameter types were set on the other command */
+		HashTable *ht = stmt->bound_params;
+		struct pdo_bound_param_data *param;
+
+		zend_hash_internal_pointer_reset(ht);
+		while (SUCCESS == zend_hash_get_current_data(ht, (void**)&param)) {
+			if (param->is_param) {
+				oledb_stmt_clear_param(stmt, param TSRMLS_CC);
+				hr = oledb_stmt_bind_param(stmt, param TSRMLS_CC);
+				if (!SUCCEEDED(hr)) goto cleanup;
+			}
+			zend_hash_move_forward(ht);
+		}
+	}
+
+cleanup:
+	CoTaskMemFree(text);
+	SAFE_RELEASE(pICommandText);
+	SAFE_RELEASE(pICommandTextAlt);
+	if (!SUCCEEDED(hr) && read) {
+		/* run on the primary instead */
+		if (S->onReadSession) {
+			oledb_stmt_swap_commands(S);
+		}
+		oledb_stmt_release_alt_command(S);
+		hr = S_OK;
+	}
+	return hr;
+}
+
+static HRESULT oledb_stmt_deferred_prepare(pdo_stmt_t *stmt TSRMLS_DC)
+{
+	pdo_oledb_stmt *S = (pdo_oledb_stmt*)stmt->driver_data;
+	pdo_oledb_db_handle *H = S->H;
+	ICommandPrepare *pICommandPrepare = NULL;
+	HRESULT hr = S_OK;
+	BOOL described = (S->paramInfo != NULL);
+
+	S->flags &= ~PREPARE_PENDING;
+	QUERY_INTERFACE(S->pICommand, IID_ICommandPrepare, pICommandPrepare);
+	if (!pICommandPrepare) {
+		S->flags &= ~CACHED_COMMAND;
+		goto cleanup;
+	}
+
+	if (!described) {
+		/* drop the guessed types so the provider describes the parameters itself */
+		CALL(SetParameterInfo, S->pICommandWithParameters, 0, NULL, NULL);
+	}
+	hr = CALL(Prepare, pICommandPrepare, 0);
+	if (!SUCCEEDED(hr)) goto cleanup;
+
+	if (!described) {
+		if (SUCCEEDED(CALL(GetParameterInfo, S->pICommandWithParameters, &S->paramCount, &S->paramInfo, &S->paramNamesBuffer))) {
+			oledb_add_cached_statement(H->cache, S->cacheKey, S->cacheKeyLen, S->paramCount, S->paramInfo, S->paramNamesBuffer);
+		}
+		if (stmt->bound_params) {
+			/* bind again with what we know now */
+			HashTable *ht = stmt->bound_params;
+			struct pdo_bound_param_data *param;
+
+			zend_hash_internal_pointer_reset(ht);
+			while (SUCCESS == zend_hash_get_current_data(ht, (void**)&param)) {
+				if (param->is_param) {
+					oledb_stmt_clear_param(stmt, param TSRMLS_CC);
+					hr = oledb_stmt_bind_param(stmt, param TSRMLS_CC);
+					if (!SUCCEEDED(hr)) goto cleanup;
+				}
+				zend_hash_move_forward(ht);
+			}
+		}
+	}
+
+cleanup:
+	SAFE_RELEASE(pICommandPrepare);
+	return hr;
+}
+
+static HRESULT oledb_stmt_get_next_rowset(pdo_stmt_t *stmt TSRMLS_DC)
+{
+	pdo_oledb_stmt *S = (pdo_oledb_stmt*)stmt->driver_data;
+	HRESULT hr;
+
+	/* skip over results that are just row counts, unless the caller wants one result per statement */
+	do {
+		DBROWCOUNT rows_affected = DB_COUNTUNAVAILABLE;
+		hr = CALL(GetResult, S->pIMultipleResults, NULL, DBRESULTFLAG_DEFAULT, &IID_IRowset, &rows_affected, (IUnknown **) &S->pIRowset);
+		if (SUCCEEDED(hr) && hr != DB_S_NORESULT && rows_affected != DB_COUNTUNAVAILABLE) {
+			S->rowsAffected = rows_affected;
+			stmt->row_count = (long) rows_affected;
+		} else if (S->flags & COUNT_RESULTS) {
+			stmt->row_count = -1;
+		}
+	} while (SUCCEEDED(hr) && hr != DB_S_NORESULT && !S->pIRowset && !(S->flags & COUNT_RESULTS));
+
+	if (!SUCCEEDED(hr) || hr == DB_S_NORESULT) {
+		/* nothing more--let go of the connection */
+		RELEASE(S->pIMultipleResults);
+		S->pIMultipleResults = NULL;
+	}
+	return hr;
+}
+
+static HRESULT oledb_stmt_set_async_property(pdo_oledb_stmt *S, BOOL async)
+{
+	ICommandProperties *pICommandProperties = NULL;
+	HRESULT hr = QUERY_INTERFACE(S->pICommand, IID_ICommandProperties, pICommandProperties);
+	if (pICommandProperties) {
+		DBPROP prop;
+		DBPROPSET prop_set;
+		prop_set.rgProperties = &prop;
+		prop_set.cProperties = 1;
+		prop_set.guidPropertySet = DBPROPSET_ROWSET;
+		prop.dwOptions = DBPROPOPTIONS_OPTIONAL;
+		prop.dwPropertyID = DBPROP_ROWSET_ASYNCH;
+		prop.colid = DB_NULLID;
+		VariantInit(&prop.vValue);
+		V_VT(&prop.vValue) = VT_I4;
+		V_I4(&prop.vValue) = (async) ? DBPROPVAL_ASYNCH_INITIALIZE : 0;
+
+		hr = CALL(SetProperties, pICommandProperties, 1, &prop_set);
+		RELEASE(pICommandProperties);
+	}
+	if (async) {
+		/* the property stays with the command, so don't pass it on */
+		S->flags |= ASYNC_COMMAND;
+		S->flags &= ~CACHED_COMMAND;
+	} else {
+		S->flags &= ~ASYNC_COMMAND;
+	}
+	return hr;
+}
+
+static HRESULT oledb_stmt_set_timeout_property(pdo_oledb_stmt *S)
+{
+	ICommandProperties *pICommandProperties = NULL;
+	HRESULT hr = QUERY_INTERFACE(S->pICommand, IID_ICommandProperties, pICommandProperties);
+	if (pICommandProperties) {
+		DBPROP prop;
+		DBPROPSET prop_set;
+		prop_set.rgProperties = &prop;
+		prop_set.cProperties = 1;
+		prop_set.guidPropertySet = DBPROPSET_ROWSET;
+		prop.dwOptions = DBPROPOPTIONS_OPTIONAL;
+		prop.dwPropertyID = DBPROP_COMMANDTIMEOUT;
+		prop.colid = DB_NULLID;
+		VariantInit(&prop.vValue);
+		V_VT(&prop.vValue) = VT_I4;
+		V_I4(&prop.vValue) = S->timeout;
+
+		hr = CALL(SetProperties, pICommandProperties, 1, &prop_set);
+		RELEASE(pICommandProperties);
+	}
+	if (S->timeout > 0) {
+		/* the property stays with the command, so don't pass it on */
+		S->flags |= TIMEOUT_COMMAND;
+		S->flags &= ~CACHED_COMMAND;
+	} else {
+		S->flags &= ~TIMEOUT_COMMAND;
+	}
+	return hr;
+}
+
+static VOID CALLBACK oledb_stmt_watchdog(PVOID param, BOOLEAN fired)
+{
+	/* the provider didn't enforce the timeout itself--called on a timer thread */
+	ICommand *pICommand = (ICommand *) param;
+	CALL(Cancel, pICommand);
+}
+
+static int oledb_stmt_describe(pdo_stmt_t *stmt, int colno TSRMLS_DC);
+
+static void oledb_stmt_describe_columns(pdo_stmt_t *stmt TSRMLS_DC)
+{
+	pdo_dbh_t *dbh = stmt->dbh;
+	int col;
+
+	/* what pdo_stmt_describe_columns() does--PDO only calls it on the first execute */
+	stmt->columns = ecalloc(max(stmt->column_count, 1), sizeof(struct pdo_column_data));
+	if (!oledb_stmt_describe(stmt, 0 TSRMLS_CC)) {
+		return;
+	}
+	for (col = 0; col < stmt->column_count; col++) {
+		char *s = stmt->columns[col].name;
+
+		if (dbh->native_case != dbh->desired_case && dbh->desired_case != PDO_CASE_NATURAL) {
+			switch (dbh->desired_case) {
+				case PDO_CASE_UPPER:
+					for (; *s; s++) *s = toupper(*s);
+					break;
+				case PDO_CASE_LOWER:
+					for (; *s; s++) *s = tolower(*s);
+					break;
+			}
+		}
+		if (stmt->bound_columns) {
+			struct pdo_bound_param_data *param;
+			if (zend_hash_find(stmt->bound_columns, stmt->columns[col].name, stmt->columns[col].namelen, (void **) &param) == SUCCESS) {
+				param->paramno = col;
+			}
+		}
+	}
+}
+
+static HRESULT oledb_stmt_finish_async(pdo_stmt_t *stmt, DWORD timeout, BOOL *pComplete TSRMLS_DC)
+{
+	pdo_oledb_stmt *S = (pdo_oledb_stmt*)stmt->driver_data;
+	HRESULT hr = S_OK;
+	DBCOUNTITEM progress, progress_max;
+	DBASYNCHPHASE phase = DBASYNCHPHASE_INITIALIZATION;
+	DWORD waited = 0;
+
+	*pComplete = TRUE;
+	if (!(S->flags & ASYNC_PENDING)) {
+		return S_OK;
+	}
+
+	/* the rowset is usable once it's past initialization */
+	for (;;) {
+		hr = CALL(GetStatus, S->pIDBAsynchStatus, DB_NULL_HCHAPTER, DBASYNCHOP_OPEN, &progress, &progress_max, &phase, NULL);
+		if (!SUCCEEDED(hr) || phase != DBASYNCHPHASE_INITIALIZATION) {
+			break;
+		}
+		if (timeout != INFINITE && waited >= timeout) {
+			*pComplete = FALSE;
+			return S_OK;
+		}
+		Sleep(PDO_OLEDB_ASYNC_POLL_INTERVAL);
+		waited += PDO_OLEDB_ASYNC_POLL_INTERVAL;
+	}
+
+	RELEASE(S->pIDBAsynchStatus);
+	S->pIDBAsynchStatus = NULL;
+	S->flags &= ~ASYNC_PENDING;
+	if (SUCCEEDED(hr) && phase == DBASYNCHPHASE_CANCELED) {
+		hr = DB_E_CANCELED;
+	}
+	if (!SUCCEEDED(hr)) goto cleanup;
+
+	/* do what execute would have done */
+	if (stmt->supports_placeholders != PDO_PLACEHOLDER_NONE && stmt->bound_params) {
+		hr = oledb_stmt_sync_output_params(stmt TSRMLS_CC);
+		if (!SUCCEEDED(hr)) goto cleanup;
+	}
+	hr = oledb_stmt_bind_columns(stmt TSRMLS_CC);
+	if (!SUCCEEDED(hr)) goto cleanup;
+
+	if (S->flags & ASYNC_DESCRIBE) {
+		/* PDO described the columns before there were any--the array it made has no names in it,
+		   and the names the describer hands out belong to S->columns */
+		SAFE_EFREE(stmt->columns);
+		oledb_stmt_describe_columns(stmt TSRMLS_CC);
+	}
+
+cleanup:
+	S->flags &= ~ASYNC_DESCRIBE;
+	if (!SUCCEEDED(hr)) {
+		oledb_stmt_clear_rowset(stmt TSRMLS_CC);
+	}
+	return hr;
+}
+
 static int oledb_stmt_execute(pdo_stmt_t *stmt TSRMLS_DC)
 {
 	pdo_oledb_stmt *S = (pdo_oledb_stmt*)stmt->driver_data;
@@ -1027,6 +1614,7 @@ static int oledb_stmt_execute(pdo_stmt_t *stmt TSRMLS_DC)
 	int ret = 0;
 	BSTR sql_w = NULL;
 	ICommandText *pICommandText = NULL;
+	HANDLE watchdog = NULL;
 
 	HRESULT hr;
 	DBPARAMS params = { NULL, 0, 0 } ;
@@ -1036,6 +1624,13 @@ static int oledb_stmt_execute(pdo_stmt_t *stmt TSRMLS_DC)
 	SAFE_RELEASE(S->pIMultipleResults);
 	S->pIMultipleResults = NULL;
 
+	/* statements queued by PDO::exec() go first */
+	hr = oledb_flush_batch(stmt->dbh TSRMLS_CC);
+	if (!SUCCEEDED(hr)) goto cleanup;
+
+	hr = oledb_stmt_select_session(stmt TSRMLS_CC);
+	if (!SUCCEEDED(hr)) goto cleanup;
+
 	/* set command text now if provider doesn't support placeholders */
 	if (stmt->supports_placeholders == PDO_PLACEHOLDER_NONE) {
 		hr = QUERY_INTERFACE(S->pICommand, IID_ICommandText, pICommandText);
@@ -1047,8 +1642,14 @@ static int oledb_stmt_execute(pdo_stmt_t *stmt TSRMLS_DC)
 		if (!SUCCEEDED(hr)) goto cleanup;
 	}
 
-	/* handle bound params */
-	if (stmt->bound_params && stmt->bound_params->nNumOfElements > 0) {
+	/* a statement run more than once is worth preparing */
+	if ((S->flags & PREPARE_PENDING) && stmt->executed) {
+		hr = oledb_stmt_deferred_prepare(stmt TSRMLS_CC);
+		if (!SUCCEEDED(hr)) goto cleanup;
+	}
+
+	/* handle bound params, unless PDO has put them into the query already */
+	if (stmt->supports_placeholders != PDO_PLACEHOLDER_NONE && stmt->bound_params && stmt->bound_params->nNumOfElements > 0) {
 		hr = oledb_stmt_copy_bound_params(stmt, &params TSRMLS_CC);
 		if (!SUCCEEDED(hr)) goto cleanup;
 	}
@@ -1129,19 +1730,82 @@ static int oledb_stmt_execute(pdo_stmt_t *stmt TSRMLS_DC)
 		}
 	}
 
-	if (FALSE && H->flags & MULTIPLE_RESULTS) {
-		hr = CALL(Execute, S->pICommand, NULL, &IID_IMultipleResults, &params, &S->rowsAffected, (IUnknown **) &S->pIMultipleResults);
-		if(!S->pIMultipleResults) goto cleanup;
+	/* have the rowset populated in the background */
+	if (S->flags & (EXECUTE_ASYNC | ASYNC_COMMAND)) {
+		hr = oledb_stmt_set_async_property(S, (S->flags & EXECUTE_ASYNC) != 0);
+		if (!SUCCEEDED(hr)) goto cleanup;
+	}
 
-		hr = CALL(GetResult, S->pIMultipleResults, NULL, DBRESULTFLAG_ROWSET, &IID_IRowset, &S->rowsAffected, (IUnknown **) &S->pIRowset);
+	/* limit how long the server can take */
+	if (S->timeout > 0 || (S->flags & TIMEOUT_COMMAND)) {
+		hr = oledb_stmt_set_timeout_property(S);
 		if (!SUCCEEDED(hr)) goto cleanup;
+	}
+	if (S->timeout > 0 && !(S->flags & EXECUTE_ASYNC)) {
+		ADDREF(S->pICommand);
+		if (!CreateTimerQueueTimer(&watchdog, NULL, oledb_stmt_watchdog, S->pICommand, S->timeout * 1000 + PDO_OLEDB_WATCHDOG_GRACE, 0, WT_EXECUTEONLYONCE)) {
+			RELEASE(S->pICommand);
+			watchdog = NULL;
+		}
+	}
+
+	stmt->row_count = 0;
+	if (S->flags & NO_ROWSET) {
+		/* don't have the provider set up a rowset that won't be used */
+		S->rowsAffected = DB_COUNTUNAVAILABLE;
+		hr = CALL(Execute, S->pICommand, NULL, &IID_NULL, &params, (DBROWCOUNT *) &S->rowsAffected, NULL);
+		if (SUCCEEDED(hr) && S->rowsAffected != DB_COUNTUNAVAILABLE) {
+			stmt->row_count = (long) S->rowsAffected;
+		}
+	} else if ((H->flags & MULTIPLE_RESULTS) && !(S->flags & (EXECUTE_ASYNC | SCROLLABLE_CURSOR | SERVER_SIDE_CURSOR))) {
+		/* results are handed out one by one through nextRowset() */
+#ifdef PDO_OLEDB_TESTS
+		if (S->standInResults) {
+			hr = oledb_create_test_results(stmt, S->standInResults, &S->pIMultipleResults TSRMLS_CC);
+		} else
+#endif
+		hr = CALL(Execute, S->pICommand, NULL, &IID_IMultipleResults, &params, NULL, (IUnknown **) &S->pIMultipleResults);
+		if (SUCCEEDED(hr) && S->pIMultipleResults) {
+			hr = oledb_stmt_get_next_rowset(stmt TSRMLS_CC);
+		}
 	} else {
-		hr = CALL(Execute, S->pICommand, NULL, &IID_IRowset, &params, &S->rowsAffected, (IUnknown **) &S->pIRowset);
-		if (!SUCCEEDED(hr)) goto cleanup;
+		S->rowsAffected = DB_COUNTUNAVAILABLE;
+		hr = CALL(Execute, S->pICommand, NULL, &IID_IRowset, &params, (DBROWCOUNT *) &S->rowsAffected, (IUnknown **) &S->pIRowset);
+		if (SUCCEEDED(hr) && S->rowsAffected != DB_COUNTUNAVAILABLE) {
+			stmt->row_count = (long) S->rowsAffected;
+		}
+	}
+	if (watchdog) {
+		/* wait for the callback in case it's running */
+		DeleteTimerQueueTimer(NULL, watchdog, INVALID_HANDLE_VALUE);
+		RELEASE(S->pICommand);
+		watchdog = NULL;
+	}
+	if (!SUCCEEDED(hr)) {
+		/* the parameter info might be stale if the objects involved were changed */
+		oledb_remove_cached_statement(H->cache, S->cacheKey, S->cacheKeyLen);
+		S->flags &= ~CACHED_COMMAND;
+		goto cleanup;
+	}
+	if (oledb_is_schema_change(S->cacheKey, S->cacheKeyLen)) {
+		oledb_clear_statement_cache(H->cache);
+	}
+
+	if ((S->flags & EXECUTE_ASYNC) && S->pIRowset) {
+		QUERY_INTERFACE(S->pIRowset, IID_IDBAsynchStatus, S->pIDBAsynchStatus);
+		if (S->pIDBAsynchStatus) {
+			/* the rest is done once the provider is finished */
+			S->flags |= ASYNC_PENDING;
+			if (!stmt->executed) {
+				S->flags |= ASYNC_DESCRIBE;
+			}
+			ret = 1;
+			goto cleanup;
+		}
 	}
 
-	/* copy any output values */
-	if (stmt->bound_params) {
+	/* copy any output values--with more results to come, nextRowset() does it after the last one */
+	if (stmt->supports_placeholders != PDO_PLACEHOLDER_NONE && stmt->bound_params && !S->pIMultipleResults) {
 		hr = oledb_stmt_sync_output_params(stmt TSRMLS_CC);
 		if (!SUCCEEDED(hr)) goto cleanup;
 	}
@@ -1247,6 +1911,10 @@ static int oledb_stmt_param_hook(pdo_stmt_t *stmt, struct pdo_bound_param_data *
     
 	if (param->is_param) {
 		pdo_oledb_param *P = (pdo_oledb_param*)param->driver_data;
+		if (stmt->supports_placeholders == PDO_PLACEHOLDER_NONE) {
+			/* the values are inlined by PDO */
+			return 1;
+		}
 		if (!S->pICommandWithParameters || !S->pIAccessorCommand) {
 			/* shouldn't happen */
 			strcpy(stmt->error_code, "58004");
@@ -1305,7 +1973,12 @@ static int oledb_stmt_fetch(pdo_stmt_t *stmt,
 	DBCOUNTITEM rows_to_fetch;
 	DBCOUNTITEM row_offset, new_index;
 	HROW *hRows = &S->hRow;
+	BOOL complete;
 
+	if (S->flags & ASYNC_PENDING) {
+		hr = oledb_stmt_finish_async(stmt, INFINITE, &complete TSRMLS_CC);
+		if (!SUCCEEDED(hr)) goto cleanup;
+	}
 	if (!S->pIRowset) goto cleanup;
 
 	if (*hRows) {
@@ -1534,9 +2207,9 @@ static int oledb_stmt_col_meta(pdo_stmt_t *stmt, long colno, zval *return_value
 
 char *oledb_datetime_to_str(DBTIMESTAMP *ts)
 {
-	/* convert to YYYY-MM-DD hh:mm:ss format */
-	char buffer[20];
-	sprintf(buffer, "%04d-%02d-%02d %02d:%02d:%02d", ts->year, ts->month, ts->day, ts->hour, ts->minute, ts->second + (ts->fraction >= 500000000) ? 1 : 0);
+	/* convert to YYYY-MM-DD hh:mm:ss.fff format, same as what SQL Server gives */
+	char buffer[32];
+	sprintf(buffer, "%04d-%02d-%02d %02d:%02d:%02d.%03d", ts->year, ts->month, ts->day, ts->hour, ts->minute, ts->second, (int) (ts->fraction / 1000000));
 	return estrdup(buffer);
 }
 
@@ -1693,10 +2366,21 @@ HRESULT oledb_stmt_set_driver_option(pdo_stmt_t *stmt, long attr, zval *val TSRM
 	HRESULT hr = E_UNEXPECTED;
 
 	switch (attr) {
+		case PDO_ATTR_TIMEOUT:
+			convert_to_long(val);
+			S->timeout = max(Z_LVAL_P(val), 0);
+			hr = S_OK;
+			break;
+		case PDO_OLEDB_ATTR_READ_ONLY:
+			/* takes effect on the next execute */
+			convert_to_boolean(val);
+			S->readOnly = Z_BVAL_P(val);
+			hr = S_OK;
+			break;
 		default:
 			hr = oledb_set_conversion_option(&S->conv, attr, val, FALSE TSRMLS_CC);
 			if (hr == S_FALSE) {
-				DWORD mask = UNIQUE_ROWS | SCROLLABLE_CURSOR | SERVER_SIDE_CURSOR | STRING_AS_UNICODE | STRING_AS_LOB | TRUNCATE_STRING | ADD_TABLE_NAME | ADD_CATALOG_NAME | CONVERT_DATE_TIME;
+				DWORD mask = UNIQUE_ROWS | SCROLLABLE_CURSOR | SERVER_SIDE_CURSOR | LAZY_PREPARE | EMULATE_PREPARES | NO_ROWSET | STRING_AS_UNICODE | STRING_AS_LOB | TRUNCATE_STRING | ADD_TABLE_NAME | ADD_CATALOG_NAME | CONVERT_DATE_TIME;
 				hr = oledb_set_internal_flag(attr, val, mask, &S->flags);
 			}
 	}
@@ -1739,8 +2423,16 @@ static int oledb_stmt_get_attr(pdo_stmt_t *stmt, long attr, zval *val TSRMLS_DC)
 	HRESULT hr = E_UNEXPECTED;
 
 	switch (attr) {
+		case PDO_ATTR_TIMEOUT:
+			ZVAL_LONG(val, S->timeout);
+			hr = S_OK;
+			break;
+		case PDO_OLEDB_ATTR_READ_ONLY:
+			ZVAL_BOOL(val, S->readOnly);
+			hr = S_OK;
+			break;
 		default:
-			hr = oledb_set_conversion_option(&S->conv, attr, val, FALSE TSRMLS_CC);
+			hr = oledb_get_conversion_option(S->conv, attr, val TSRMLS_CC);
 			if (hr == S_FALSE) {
 				hr = oledb_get_internal_flag(attr, S->flags, val);
 			}
@@ -1754,17 +2446,23 @@ static int oledb_stmt_next_rowset(pdo_stmt_t *stmt TSRMLS_DC)
 	pdo_oledb_stmt *S = (pdo_oledb_stmt*)stmt->driver_data;
 	pdo_oledb_db_handle *H = S->H;
 	int ret = 0;
-	HRESULT hr;
+	HRESULT hr = S_OK;
 
 	oledb_stmt_clear_rowset(stmt TSRMLS_CC);
 	if (S->pIMultipleResults) {
+		hr = oledb_stmt_get_next_rowset(stmt TSRMLS_CC);
+		if (!S->pIMultipleResults) {
+			/* output parameters are only sent after the last result */
+			if (SUCCEEDED(hr) && stmt->supports_placeholders != PDO_PLACEHOLDER_NONE && stmt->bound_params) {
+				hr = oledb_stmt_sync_output_params(stmt TSRMLS_CC);
+			}
+			goto cleanup;
+		}
 
-		/* try to get an IRowset */
-		hr = CALL(GetResult, S->pIMultipleResults, NULL, DBRESULTFLAG_ROWSET, &IID_IRowset, &S->rowsAffected, (IUnknown **) &S->pIRowset);
-		if (!S->pIRowset) goto cleanup;
-
-		hr = oledb_stmt_bind_columns(stmt TSRMLS_CC);
-		if (!SUCCEEDED(hr)) goto cleanup;
+		if (S->pIRowset) {
+			hr = oledb_stmt_bind_columns(stmt TSRMLS_CC);
+			if (!SUCCEEDED(hr)) goto cleanup;
+		}
 
 		ret = 1;
 	} 
@@ -1774,6 +2472,17 @@ cleanup:
 	return ret;
 }
 
+static int oledb_stmt_cursor_closer(pdo_stmt_t *stmt TSRMLS_DC)
+{
+	pdo_oledb_stmt *S = (pdo_oledb_stmt*)stmt->driver_data;
+
+	/* releasing the objects frees up the connection for other commands */
+	oledb_stmt_clear_rowset(stmt TSRMLS_CC);
+	SAFE_RELEASE(S->pIMultipleResults);
+	S->pIMultipleResults = NULL;
+	return 1;
+}
+
 struct pdo_stmt_methods oledb_stmt_methods = {
 	oledb_stmt_dtor,
 	oledb_stmt_execute,
@@ -1784,5 +2493,128 @@ struct pdo_stmt_methods oledb_stmt_methods = {
 	oledb_stmt_set_attr,
 	oledb_stmt_get_attr,
 	oledb_stmt_col_meta,
-	oledb_stmt_next_rowset
+	oledb_stmt_next_rowset,
+	oledb_stmt_cursor_closer
+};
+
+static void oledb_stmt_raise_error(pdo_stmt_t *stmt, HRESULT hr TSRMLS_DC)
+{
+	pdo_oledb_stmt *S = (pdo_oledb_stmt*)stmt->driver_data;
+
+	/* driver methods don't go through PDO's own error handling */
+	pdo_oledb_error_stmt(stmt, hr);
+	if (!SUCCEEDED(hr)) {
+		_pdo_raise_impl_error(stmt->dbh, stmt, stmt->error_code, SAFE_STRING(S->einfo.errmsg) TSRMLS_CC);
+	}
+}
+
+/* {{{ proto bool PDOStatement::oledbExecuteAsync([array $params])
+   Starts executing the statement without waiting for the result */
+static PHP_METHOD(PDOStatement, oledbExecuteAsync)
+{
+	zval *object = getThis();
+	pdo_stmt_t *stmt = (pdo_stmt_t*)zend_object_store_get_object(object TSRMLS_CC);
+	pdo_oledb_stmt *S = (pdo_oledb_stmt*)stmt->driver_data;
+	zval *input_params = NULL, *retval = NULL;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|a!", &input_params) == FAILURE) {
+		RETURN_FALSE;
+	}
+
+	/* let PDO handle the parameters as usual */
+	S->flags |= EXECUTE_ASYNC;
+	if (input_params) {
+		zend_call_method_with_1_params(&object, Z_OBJCE_P(object), NULL, "execute", &retval, input_params);
+	} else {
+		zend_call_method_with_0_params(&object, Z_OBJCE_P(object), NULL, "execute", &retval);
+	}
+	S->flags &= ~EXECUTE_ASYNC;
+
+	if (retval) {
+		RETURN_ZVAL(retval, 0, 1);
+	}
+	RETURN_FALSE;
+}
+/* }}} */
+
+/* {{{ proto bool PDOStatement::oledbIsComplete()
+   Returns whether an asynchronous execution has finished */
+static PHP_METHOD(PDOStatement, oledbIsComplete)
+{
+	pdo_stmt_t *stmt = (pdo_stmt_t*)zend_object_store_get_object(getThis() TSRMLS_CC);
+	BOOL complete;
+	HRESULT hr;
+
+	hr = oledb_stmt_finish_async(stmt, 0, &complete TSRMLS_CC);
+	oledb_stmt_raise_error(stmt, hr TSRMLS_CC);
+	RETURN_BOOL(complete);
+}
+/* }}} */
+
+/* {{{ proto bool PDOStatement::oledbWait([int $timeout_ms])
+   Waits for an asynchronous execution to finish, indefinitely if no timeout is given */
+static PHP_METHOD(PDOStatement, oledbWait)
+{
+	pdo_stmt_t *stmt = (pdo_stmt_t*)zend_object_store_get_object(getThis() TSRMLS_CC);
+	long timeout = -1;
+	BOOL complete;
+	HRESULT hr;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "|l", &timeout) == FAILURE) {
+		RETURN_FALSE;
+	}
+	hr = oledb_stmt_finish_async(stmt, (timeout < 0) ? INFINITE : (DWORD) timeout, &complete TSRMLS_CC);
+	oledb_stmt_raise_error(stmt, hr TSRMLS_CC);
+	RETURN_BOOL(SUCCEEDED(hr) && complete);
+}
+/* }}} */
+
+#ifdef PDO_OLEDB_TESTS
+/* {{{ proto bool PDOStatement::oledbExecuteStandIn(array $results [, array $params])
+   Executes the statement with the provider's results replaced by the given ones (test builds only) */
+static PHP_METHOD(PDOStatement, oledbExecuteStandIn)
+{
+	zval *object = getThis();
+	pdo_stmt_t *stmt = (pdo_stmt_t*)zend_object_store_get_object(object TSRMLS_CC);
+	pdo_oledb_stmt *S = (pdo_oledb_stmt*)stmt->driver_data;
+	zval *results, *input_params = NULL, *retval = NULL;
+
+	if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "a|a!", &results, &input_params) == FAILURE) {
+		RETURN_FALSE;
+	}
+
+	/* parameters are bound as usual--only the command's execution is skipped */
+	S->standInResults = results;
+	if (input_params) {
+		zend_call_method_with_1_params(&object, Z_OBJCE_P(object), NULL, "execute", &retval, input_params);
+	} else {
+		zend_call_method_with_0_params(&object, Z_OBJCE_P(object), NULL, "execute", &retval);
+	}
+	S->standInResults = NULL;
+
+	if (retval) {
+		RETURN_ZVAL(retval, 0, 1);
+	}
+	RETURN_FALSE;
+}
+/* }}} */
+
+/* {{{ proto int PDOStatement::oledbOpenStandIns()
+   Returns the number of stand-in results objects not yet released (test builds only) */
+static PHP_METHOD(PDOStatement, oledbOpenStandIns)
+{
+	RETURN_LONG(oledb_get_test_results_count());
+}
+/* }}} */
+#endif
+
+zend_function_entry oledb_stmt_driver_methods[] = {
+	PHP_ME(PDOStatement, oledbExecuteAsync, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(PDOStatement, oledbIsComplete, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(PDOStatement, oledbWait, NULL, ZEND_ACC_PUBLIC)
+#ifdef PDO_OLEDB_TESTS
+	PHP_ME(PDOStatement, oledbExecuteStandIn, NULL, ZEND_ACC_PUBLIC)
+	PHP_ME(PDOStatement, oledbOpenStandIns, NULL, ZEND_ACC_PUBLIC)
+#endif
+	{NULL, NULL, NULL}
 };
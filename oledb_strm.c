@@ -218,12 +218,24 @@ HRESULT oledb_create_lob_stream(pdo_oledb_conversion *conv, IUnknown *pUnk, DBLE
 	return hr;
 }
 
+/* amount of input converted at a time when a parameter stream needs conversion */
+#define ZVAL_STREAM_CHUNK_SIZE		8192
+
 typedef struct {
 	ISequentialStreamVtbl *lpVtbl;
 	char *bytes;
 	unsigned int byte_count;
 	unsigned int offset;
 	php_stream *stream;
+	off_t stream_start;
+	IMLangConvertCharset *pIMLangConvertCharset;
+	char *chunk;
+	unsigned int chunk_count;
+	unsigned int chunk_offset;
+	/* converted characters the caller's buffer was too small for */
+	char pending[16];
+	unsigned int pending_count;
+	unsigned int pending_offset;
 	int own_string;
 	ULONG refcount;
 	void *tsrm_ls;
@@ -259,36 +271,121 @@ static ULONG STDMETHODCALLTYPE zval_stream_Release(ISequentialStream *ptr)
 		if (this->own_string) {
 			SAFE_EFREE(this->bytes);
 		}
+		SAFE_RELEASE(this->pIMLangConvertCharset);
+		CoTaskMemFree(this->chunk);
 		CoTaskMemFree(this);
 		return 0;
 	}
 	return this->refcount;
 }
 
+static unsigned int zval_stream_read_source(zval_stream *this, char *buf, unsigned int count)
+{
+	if (this->stream) {
+		void *tsrm_ls = this->tsrm_ls;
+		return php_stream_read(this->stream, buf, count);
+	} else if (this->bytes) {
+		unsigned int len = min(count, this->byte_count - this->offset);
+		memcpy(buf, this->bytes + this->offset, len);
+		this->offset += len;
+		return len;
+	}
+	return 0;
+}
+
+static HRESULT zval_stream_read_converted(zval_stream *this, char *buf, unsigned int count, unsigned int *pRead)
+{
+	HRESULT hr = S_OK;
+	unsigned int total = 0;
+
+	if (this->pending_offset < this->pending_count) {
+		total = min(count, this->pending_count - this->pending_offset);
+		memcpy(buf, this->pending + this->pending_offset, total);
+		this->pending_offset += total;
+	}
+
+	while (total < count) {
+		UINT len_src = this->chunk_count - this->chunk_offset;
+		UINT len_dest = count - total;
+		unsigned int leftover, read;
+
+		if (len_src > 0) {
+			hr = CALL(DoConversion, this->pIMLangConvertCharset, (BYTE *) this->chunk + this->chunk_offset, &len_src, (BYTE *) buf + total, &len_dest);
+			if (hr != S_OK) {
+				hr = E_FAIL;
+				break;
+			}
+			this->chunk_offset += len_src;
+			total += len_dest;
+			if (len_src > 0) {
+				continue;
+			}
+			/* nothing got converted: either the output buffer is nearly full or the chunk 
+			   ends with an incomplete character */
+			if (total > 0) {
+				break;
+			}
+			if (count < sizeof(this->pending)) {
+				/* not even one character fits--convert into our own buffer and hand out what does */
+				len_src = this->chunk_count - this->chunk_offset;
+				len_dest = sizeof(this->pending);
+				hr = CALL(DoConversion, this->pIMLangConvertCharset, (BYTE *) this->chunk + this->chunk_offset, &len_src, (BYTE *) this->pending, &len_dest);
+				if (hr != S_OK) {
+					hr = E_FAIL;
+					break;
+				}
+				if (len_src > 0) {
+					this->chunk_offset += len_src;
+					this->pending_count = len_dest;
+					this->pending_offset = total = min(count, len_dest);
+					memcpy(buf, this->pending, total);
+					continue;
+				}
+			}
+			if (this->chunk_offset == 0 && this->chunk_count == ZVAL_STREAM_CHUNK_SIZE) {
+				break;
+			}
+		}
+
+		/* keep the unconverted bytes and pull in more input behind them */
+		leftover = this->chunk_count - this->chunk_offset;
+		memmove(this->chunk, this->chunk + this->chunk_offset, leftover);
+		this->chunk_offset = 0;
+		this->chunk_count = leftover;
+		read = zval_stream_read_source(this, this->chunk + leftover, ZVAL_STREAM_CHUNK_SIZE - leftover);
+		if (!read) {
+			/* end of input--what's left can't be converted, so it's a dangling partial character */
+			this->chunk_count = 0;
+			break;
+		}
+		this->chunk_count += read;
+	}
+	*pRead = total;
+	return hr;
+}
+
 static HRESULT STDMETHODCALLTYPE zval_stream_Read(ISequentialStream *ptr,
 			void *pv,
 			ULONG cb,
 			ULONG *pcbRead)
 {
 	DECLARE_THIS(ptr, 0);
+	unsigned int len = 0;
 
-	if (this->stream) {
-		void *tsrm_ls = this->tsrm_ls;
-		unsigned int len;
-		len = php_stream_read(this->stream, (char *) pv, cb);
-		*pcbRead = len;
-		return (len > 0) ? S_OK : S_FALSE;
-	} else if (this->bytes) {
-		unsigned int len = min(cb, this->byte_count - this->offset);
-		if (!len) {
-			return S_FALSE;
+	if (this->pIMLangConvertCharset) {
+		HRESULT hr = zval_stream_read_converted(this, (char *) pv, cb, &len);
+		if (!SUCCEEDED(hr)) {
+			return hr;
 		}
-		memcpy(pv, this->bytes + this->offset, len);
-		this->offset += len;
+	} else if (this->stream || this->bytes) {
+		len = zval_stream_read_source(this, (char *) pv, cb);
+	} else {
+		return E_FAIL;
+	}
+	if (pcbRead) {
 		*pcbRead = len;
-		return S_OK;
 	}
-	return E_FAIL;
+	return (len > 0) ? S_OK : S_FALSE;
 }
 
 static HRESULT STDMETHODCALLTYPE zval_stream_Write(ISequentialStream *ptr,
@@ -308,15 +405,52 @@ ISequentialStreamVtbl zval_stream_Vtbl = {
 	zval_stream_Write
 };
 
+static HRESULT zval_stream_measure(zval_stream *this, DBLENGTH *pLength)
+{
+	/* run through the input once to see how long the output will be, then rewind */
+	HRESULT hr = S_OK;
+	char *scratch = emalloc(ZVAL_STREAM_CHUNK_SIZE * 2);
+	DBLENGTH total = 0;
+	unsigned int len;
+
+	do {
+		if (this->pIMLangConvertCharset) {
+			hr = zval_stream_read_converted(this, scratch, ZVAL_STREAM_CHUNK_SIZE * 2, &len);
+		} else {
+			len = zval_stream_read_source(this, scratch, ZVAL_STREAM_CHUNK_SIZE * 2);
+		}
+		total += len;
+	} while (SUCCEEDED(hr) && len > 0);
+	efree(scratch);
+
+	if (this->stream) {
+		void *tsrm_ls = this->tsrm_ls;
+		if (php_stream_seek(this->stream, this->stream_start, SEEK_SET) != 0) {
+			hr = E_FAIL;
+		}
+	}
+	this->offset = 0;
+	this->chunk_count = 0;
+	this->chunk_offset = 0;
+	this->pending_count = 0;
+	this->pending_offset = 0;
+	*pLength = total;
+	return hr;
+}
+
 HRESULT oledb_create_zval_stream(pdo_oledb_conversion *conv, zval *value, int conversion, IUnknown **pUnk, DBLENGTH *pLength TSRMLS_DC)
 {
 	zval_stream *this;
 
+	HRESULT hr = S_OK;
 	char *bytes = NULL;
 	unsigned int byte_count = 0;
 	php_stream *stream = NULL;
 	php_stream_statbuf ssbuf;
+	off_t stream_start = 0;
 	int own_string = 0;
+	int length_known = 0;
+	IMLangConvertCharset *converter = (conversion != -1) ? conv->pIMLangConvertCharsets[conversion] : NULL;
 
 	if (Z_TYPE_P(value) == IS_STRING) {
 		bytes = Z_STRVAL_P(value);
@@ -328,13 +462,16 @@ HRESULT oledb_create_zval_stream(pdo_oledb_conversion *conv, zval *value, int co
 			oledb_set_automation_error(L"Expected a stream resource", L"HY105");
 			return ERROR_INVALID_PARAMETER;
 		}
-		
-		/* we need to read the entire contents of the stream to determine the final length if:
-			1. the contents is to be converted to Unicode or some other encoding
-			2. the stream has filters attached (which might after the content length)
-			3. the stream doesn't support stat
-		*/
-		if ((php_stream_stat(stream, &ssbuf) != 0 || !ssbuf.sb.st_size) || conversion != -1 || php_stream_is_filtered(stream)) {
+
+		stream_start = php_stream_tell(stream);
+		if (!converter && !php_stream_is_filtered(stream) && php_stream_stat(stream, &ssbuf) == 0 && ssbuf.sb.st_size) {
+			/* the bytes will be sent as is, so the file size is what we need */
+			*pLength = ssbuf.sb.st_size - max(stream_start, 0);
+			length_known = 1;
+		} else if (stream_start < 0 || php_stream_is_filtered(stream) || php_stream_seek(stream, stream_start, SEEK_SET) != 0) {
+			/* the final length can only be found by reading the contents and there's no way to go back
+			   afterward (filters carry state that can't be rewound)--keep the contents in memory instead
+			*/
 			byte_count = php_stream_copy_to_mem(stream, &bytes, PHP_STREAM_COPY_ALL, 0);
 			own_string = 1;
 			stream = NULL;
@@ -344,26 +481,23 @@ HRESULT oledb_create_zval_stream(pdo_oledb_conversion *conv, zval *value, int co
 		copy = *value;
 		zval_copy_ctor(&copy);
 		convert_to_string(&copy);
-		bytes = Z_STRVAL_P(value);
-		byte_count = Z_STRLEN_P(value);
+		bytes = Z_STRVAL(copy);
+		byte_count = Z_STRLEN(copy);
 		own_string = 1;
 	}
 
-	if (conversion != -1) {
-		/* convert bytes to Unicode or another encoding scheme */
-		HRESULT hr;
-		unsigned int len = byte_count;
-		unsigned char *src = (unsigned char *) bytes;
-
-		hr = oledb_convert_string(conv, src, len, &bytes, &byte_count, conversion);
-		if (hr == S_FALSE) {
-			if (own_string) {
-				efree(src);
-			}
-		}
+	if (!converter && !stream) {
+		*pLength = byte_count;
+		length_known = 1;
 	}
 
 	this = CoTaskMemAlloc(sizeof(*this));
+	if (!this) {
+		if (own_string) {
+			SAFE_EFREE(bytes);
+		}
+		return E_OUTOFMEMORY;
+	}
 	ZeroMemory(this, sizeof(*this));
 	this->lpVtbl = &zval_stream_Vtbl;
 #ifdef ZTS
@@ -372,14 +506,30 @@ HRESULT oledb_create_zval_stream(pdo_oledb_conversion *conv, zval *value, int co
 	this->tsrm_ls = NULL;
 #endif
 	this->stream = stream;
+	this->stream_start = stream_start;
 	this->bytes = bytes;
 	this->byte_count = byte_count;
 	this->own_string = own_string;
-	
-	if (stream) {
-		*pLength = ssbuf.sb.st_size;
-	} else {
-		*pLength = this->byte_count;
+	this->refcount = 1;
+
+	if (converter) {
+		/* convert bytes to Unicode or another encoding scheme as the provider reads them */
+		this->pIMLangConvertCharset = converter;
+		ADDREF(this->pIMLangConvertCharset);
+		this->chunk = CoTaskMemAlloc(ZVAL_STREAM_CHUNK_SIZE);
+		if (!this->chunk) {
+			hr = E_OUTOFMEMORY;
+		}
+	}
+
+	if (SUCCEEDED(hr) && !length_known) {
+		/* providers want the length up front */
+		hr = zval_stream_measure(this, pLength);
+	}
+
+	if (SUCCEEDED(hr)) {
+		hr = QUERY_INTERFACE((IUnknown *) this, IID_IUnknown, *pUnk);
 	}
-	return QUERY_INTERFACE((IUnknown *) this, IID_IUnknown, *pUnk);
+	RELEASE((IUnknown *) this);
+	return hr;
 }
@@ -0,0 +1,187 @@
+/*
+  +----------------------------------------------------------------------+
+  | PHP Version 5                                                        |
+  +----------------------------------------------------------------------+
+  | Copyright (c) 1997-2007 The PHP Group                                |
+  +----------------------------------------------------------------------+
+  | This source file is subject to version 3.0 of the PHP license,       |
+  | that is bundled with this package in the file LICENSE, and is        |
+  | available through the world-wide-web at the following url:           |
+  | http://www.php.net/license/3_0.txt.                                  |
+  | If you did not receive a copy of the PHP license and are unable to   |
+  | obtain it through the world-wide-web, please send a note to          |
+  | license@php.net so we can mail you a copy immediately.               |
+  +----------------------------------------------------------------------+
+  | Author: Chung Leong <cleong@cal.berkeley.edu>                        |
+  +----------------------------------------------------------------------+
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "php.h"
+#include "php_ini.h"
+#include "ext/standard/info.h"
+#include "pdo/php_pdo.h"
+#include "pdo/php_pdo_driver.h"
+#include "php_pdo_oledb.h"
+#include "php_pdo_oledb_int.h"
+
+#ifdef PDO_OLEDB_TESTS
+
+/* a stand-in for the provider's IMultipleResults, so that the handling of results can be tested
+   without a server that produces them on cue--each element of a PHP array is one result: an array
+   of rows becomes a rowset, anything else the number of rows affected
+*/
+
+typedef struct {
+	IMultipleResultsVtbl *lpVtbl;
+	zval *results;
+	HashPosition position;
+	pdo_stmt_t *stmt;
+	ULONG refcount;
+	void *tsrm_ls;
+} test_results;
+
+/* stand-ins that haven't been released yet */
+static LONG test_results_count = 0;
+
+#define DECLARE_THIS(vtbl, offset)		test_results *this = ((test_results *) &((IUnknown *) vtbl)[- offset])
+
+static void test_results_set_output_params(test_results *this)
+{
+	pdo_oledb_stmt *S = (pdo_oledb_stmt *) this->stmt->driver_data;
+	HashTable *ht = this->stmt->bound_params;
+	struct pdo_bound_param_data *param;
+
+	/* a provider fills in output parameters once the last result has been read--report them as null */
+	if (!ht || !S->inputBuffer) {
+		return;
+	}
+	zend_hash_internal_pointer_reset(ht);
+	while (SUCCESS == zend_hash_get_current_data(ht, (void**)&param)) {
+		pdo_oledb_param *P = (pdo_oledb_param*)param->driver_data;
+		if (P && (P->ioFlags & DBPARAMIO_OUTPUT)) {
+			*((DWORD *) (((char *) S->inputBuffer) + P->byteOffset)) = DBSTATUS_S_ISNULL;
+		}
+		zend_hash_move_forward(ht);
+	}
+}
+
+static HRESULT STDMETHODCALLTYPE test_results_QueryInterface(IMultipleResults *ptr,
+            /* [in] */ REFIID riid,
+            /* [iid_is][out] */ void **ppvObject)
+{
+	DECLARE_THIS(ptr, 0);
+	if (IsEqualIID(riid, &IID_IUnknown) || IsEqualIID(riid, &IID_IMultipleResults)) {
+		*ppvObject = &this->lpVtbl;
+	} else {
+		*ppvObject = NULL;
+		return E_NOINTERFACE;
+	}
+	ADDREF((IUnknown *) *ppvObject);
+	return S_OK;
+}
+
+static ULONG STDMETHODCALLTYPE test_results_AddRef(IMultipleResults *ptr)
+{
+	DECLARE_THIS(ptr, 0);
+	return ++(this->refcount);
+}
+
+static ULONG STDMETHODCALLTYPE test_results_Release(IMultipleResults *ptr)
+{
+	DECLARE_THIS(ptr, 0);
+	if(--(this->refcount) == 0) {
+		zval_ptr_dtor(&this->results);
+		CoTaskMemFree(this);
+		InterlockedDecrement(&test_results_count);
+		return 0;
+	}
+	return this->refcount;
+}
+
+static HRESULT STDMETHODCALLTYPE test_results_GetResult(IMultipleResults *ptr,
+            /* [in] */ IUnknown *pUnkOuter,
+            /* [in] */ DBRESULTFLAG lResultFlag,
+            /* [in] */ REFIID riid,
+            /* [out] */ DBROWCOUNT *pcRowsAffected,
+            /* [iid_is][out] */ IUnknown **ppRowset)
+{
+	DECLARE_THIS(ptr, 0);
+	void *tsrm_ls = this->tsrm_ls;
+	pdo_oledb_stmt *S = (pdo_oledb_stmt *) this->stmt->driver_data;
+	HRESULT hr = S_OK;
+	zval **result;
+
+	if (ppRowset) {
+		*ppRowset = NULL;
+	}
+	if (pcRowsAffected) {
+		*pcRowsAffected = DB_COUNTUNAVAILABLE;
+	}
+	if (zend_hash_get_current_data_ex(Z_ARRVAL_P(this->results), (void **) &result, &this->position) == FAILURE) {
+		test_results_set_output_params(this);
+		return DB_S_NORESULT;
+	}
+	zend_hash_move_forward_ex(Z_ARRVAL_P(this->results), &this->position);
+
+	if (Z_TYPE_PP(result) == IS_ARRAY) {
+		IUnknown *pUnk = NULL;
+		hr = oledb_create_zval_rowset(S->conv, *result, &pUnk TSRMLS_CC);
+		if (pUnk) {
+			if (ppRowset) {
+				hr = CALL(QueryInterface, pUnk, riid, (void **) ppRowset);
+			}
+			RELEASE(pUnk);
+		}
+	} else if (pcRowsAffected) {
+		zval copy = **result;
+		zval_copy_ctor(&copy);
+		convert_to_long(&copy);
+		*pcRowsAffected = Z_LVAL(copy);
+	}
+	return hr;
+}
+
+IMultipleResultsVtbl test_results_Vtbl = {
+	test_results_QueryInterface,
+	test_results_AddRef,
+	test_results_Release,
+	test_results_GetResult
+};
+
+HRESULT oledb_create_test_results(pdo_stmt_t *stmt, zval *results, IMultipleResults **ppIMultipleResults TSRMLS_DC)
+{
+	test_results *this;
+
+	*ppIMultipleResults = NULL;
+	this = CoTaskMemAlloc(sizeof(*this));
+	if (!this) {
+		return E_OUTOFMEMORY;
+	}
+	ZeroMemory(this, sizeof(*this));
+	this->lpVtbl = &test_results_Vtbl;
+#ifdef ZTS
+	this->tsrm_ls = tsrm_ls;
+#else
+	this->tsrm_ls = NULL;
+#endif
+	this->stmt = stmt;
+	this->results = results;
+	Z_ADDREF_P(results);
+	zend_hash_internal_pointer_reset_ex(Z_ARRVAL_P(results), &this->position);
+	this->refcount = 1;
+	InterlockedIncrement(&test_results_count);
+
+	*ppIMultipleResults = (IMultipleResults *) this;
+	return S_OK;
+}
+
+long oledb_get_test_results_count(void)
+{
+	return test_results_count;
+}
+
+#endif
@@ -30,12 +30,24 @@
 #include "php_pdo_oledb.h"
 #include "php_pdo_oledb_int.h"
 
+ZEND_DECLARE_MODULE_GLOBALS(pdo_oledb)
+
 /* {{{ pdo_oledb_functions[] */
 const zend_function_entry pdo_oledb_functions[] = {
 	{NULL, NULL, NULL}
 };
 /* }}} */
 
+/* {{{ PHP_INI */
+PHP_INI_BEGIN()
+	PHP_INI_ENTRY("pdo_oledb.pool_max_size",		"0",	PHP_INI_SYSTEM, NULL)
+	PHP_INI_ENTRY("pdo_oledb.pool_min_size",		"0",	PHP_INI_SYSTEM, NULL)
+	PHP_INI_ENTRY("pdo_oledb.pool_idle_timeout",	"300",	PHP_INI_SYSTEM, NULL)
+	PHP_INI_ENTRY("pdo_oledb.share_data_sources",	"0",	PHP_INI_SYSTEM, NULL)
+	PHP_INI_ENTRY("pdo_oledb.com_threading_model",	"apartment",	PHP_INI_SYSTEM, NULL)
+PHP_INI_END()
+/* }}} */
+
 /* {{{ pdo_oledb_deps[] */
 #if ZEND_MODULE_API_NO >= 20050922
 static zend_module_dep pdo_oledb_deps[] = {
@@ -99,15 +111,78 @@ int link_pdo(void) {
 		&& _php_pdo_stmt_delref;
 }
 
+static DWORD com_init_flags = COINIT_APARTMENTTHREADED;
+
+#define COM_NOT_STARTED		0
+#define COM_STARTED			1
+#define COM_STARTED_ELSEWHERE	2
+
+/* COM stays up for the life of the thread--tearing it down after each request can unload providers */
+static void oledb_com_thread_startup(TSRMLS_D)
+{
+	if (PDO_OLEDB_G(comState) == COM_NOT_STARTED) {
+		HRESULT hr = CoInitializeEx(NULL, com_init_flags);
+		/* RPC_E_CHANGED_MODE means someone else set up the thread, and it's theirs to undo */
+		PDO_OLEDB_G(comState) = SUCCEEDED(hr) ? COM_STARTED : COM_STARTED_ELSEWHERE;
+		PDO_OLEDB_G(comThreadId) = GetCurrentThreadId();
+	}
+}
+
+static void oledb_globals_ctor(zend_pdo_oledb_globals *pdo_oledb_globals TSRMLS_DC)
+{
+	pdo_oledb_globals->comState = COM_NOT_STARTED;
+	pdo_oledb_globals->comThreadId = 0;
+}
+
+static void oledb_globals_dtor(zend_pdo_oledb_globals *pdo_oledb_globals TSRMLS_DC)
+{
+	/* TSRM can also run this from the main thread at shutdown--only a thread can undo its own COM */
+	if (pdo_oledb_globals->comState == COM_STARTED && pdo_oledb_globals->comThreadId == GetCurrentThreadId()) {
+		CoUninitialize();
+	}
+	pdo_oledb_globals->comState = COM_NOT_STARTED;
+}
+
+static IDataInitialize *pIDataInitialize = NULL;
+static IMultiLanguage *pIMultiLanguage = NULL;
+
+static IUnknown *oledb_get_singleton(IUnknown * volatile *ppUnk, REFCLSID clsid, REFIID iid)
+{
+	if (!*ppUnk) {
+		IUnknown *pUnk = NULL;
+		CoCreateInstance(clsid, NULL, CLSCTX_INPROC_SERVER, iid, (void **) &pUnk);
+		/* if another thread got there first, use its object */
+		if (pUnk && InterlockedCompareExchangePointer((PVOID volatile *) ppUnk, pUnk, NULL) != NULL) {
+			RELEASE(pUnk);
+		}
+	}
+	return *ppUnk;
+}
+
+IDataInitialize *oledb_get_data_initialize(void)
+{
+	return (IDataInitialize *) oledb_get_singleton((IUnknown **) &pIDataInitialize, &CLSID_MSDAINITIALIZE, &IID_IDataInitialize);
+}
+
+IMultiLanguage *oledb_get_multi_language(void)
+{
+	return (IMultiLanguage *) oledb_get_singleton((IUnknown **) &pIMultiLanguage, &CLSID_CMultiLanguage, &IID_IMultiLanguage);
+}
+
 /* {{{ PHP_MINIT_FUNCTION */
 PHP_MINIT_FUNCTION(pdo_oledb)
 {
-	HRESULT hr;
-
 	if(!link_pdo()) {
 		return FAILURE;
 	}
 
+	REGISTER_INI_ENTRIES();
+	if (_stricmp(INI_STR("pdo_oledb.com_threading_model"), "multithreaded") == 0 || _stricmp(INI_STR("pdo_oledb.com_threading_model"), "mta") == 0) {
+		com_init_flags = COINIT_MULTITHREADED;
+	}
+	ZEND_INIT_MODULE_GLOBALS(pdo_oledb, oledb_globals_ctor, oledb_globals_dtor);
+	oledb_pool_startup(INI_INT("pdo_oledb.pool_max_size"), INI_INT("pdo_oledb.pool_min_size"), INI_INT("pdo_oledb.pool_idle_timeout"), INI_INT("pdo_oledb.share_data_sources"));
+
 	if (FAILURE == _php_pdo_register_driver(&pdo_oledb_driver)) {
 		return FAILURE;
 	}
@@ -132,17 +207,31 @@ PHP_MINIT_FUNCTION(pdo_oledb)
 	REGISTER_PDO_CLASS_CONST_LONG("OLEDB_ATTR_QUERY_ENCODING", (long)PDO_OLEDB_ATTR_QUERY_ENCODING);
 	REGISTER_PDO_CLASS_CONST_LONG("OLEDB_ATTR_CHAR_ENCODING", (long)PDO_OLEDB_ATTR_CHAR_ENCODING);
 	REGISTER_PDO_CLASS_CONST_LONG("OLEDB_ATTR_TRUNCATE_STRING", (long)PDO_OLEDB_ATTR_TRUNCATE_STRING);
+	REGISTER_PDO_CLASS_CONST_LONG("OLEDB_ATTR_STATEMENT_CACHE_SIZE", (long)PDO_OLEDB_ATTR_STATEMENT_CACHE_SIZE);
+	REGISTER_PDO_CLASS_CONST_LONG("OLEDB_ATTR_STATEMENT_CACHE_STATS", (long)PDO_OLEDB_ATTR_STATEMENT_CACHE_STATS);
+	REGISTER_PDO_CLASS_CONST_LONG("OLEDB_ATTR_PERSISTENT_STATEMENT_CACHE", (long)PDO_OLEDB_ATTR_PERSISTENT_STATEMENT_CACHE);
+	REGISTER_PDO_CLASS_CONST_LONG("OLEDB_ATTR_LAZY_PREPARE", (long)PDO_OLEDB_ATTR_LAZY_PREPARE);
+	REGISTER_PDO_CLASS_CONST_LONG("OLEDB_ATTR_BATCH_EXEC", (long)PDO_OLEDB_ATTR_BATCH_EXEC);
+	REGISTER_PDO_CLASS_CONST_LONG("OLEDB_ATTR_BATCH_ROW_COUNT", (long)PDO_OLEDB_ATTR_BATCH_ROW_COUNT);
+	REGISTER_PDO_CLASS_CONST_LONG("OLEDB_ATTR_NO_ROWSET", (long)PDO_OLEDB_ATTR_NO_ROWSET);
+	REGISTER_PDO_CLASS_CONST_LONG("OLEDB_ATTR_RESET_ON_REUSE", (long)PDO_OLEDB_ATTR_RESET_ON_REUSE);
+	REGISTER_PDO_CLASS_CONST_LONG("OLEDB_ATTR_LAZY_CONNECT", (long)PDO_OLEDB_ATTR_LAZY_CONNECT);
+	REGISTER_PDO_CLASS_CONST_LONG("OLEDB_ATTR_PACKET_SIZE", (long)PDO_OLEDB_ATTR_PACKET_SIZE);
+	REGISTER_PDO_CLASS_CONST_LONG("OLEDB_ATTR_BULK_TRANSFER", (long)PDO_OLEDB_ATTR_BULK_TRANSFER);
+	REGISTER_PDO_CLASS_CONST_LONG("OLEDB_ATTR_READ_ONLY", (long)PDO_OLEDB_ATTR_READ_ONLY);
+	REGISTER_PDO_CLASS_CONST_LONG("OLEDB_ATTR_ROUTE_SELECTS", (long)PDO_OLEDB_ATTR_ROUTE_SELECTS);
 
 	REGISTER_PDO_CLASS_CONST_LONG("OLEDB_CURSOR_SERVER_SIDE", (long)PDO_OLEDB_CURSOR_SERVER_SIDE);
 
-	hr = CoInitialize(NULL);
-	/* try to initialize MDAC */
-	hr = CoCreateInstance(&CLSID_MSDAINITIALIZE, NULL, CLSCTX_INPROC_SERVER, &IID_IDataInitialize,(void**) &pIDataInitialize);
+	REGISTER_PDO_CLASS_CONST_LONG("OLEDB_PACKET_SIZE_AUTO", (long)PDO_OLEDB_PACKET_SIZE_AUTO);
 
-	/* start MLang */
-	hr = CoCreateInstance(&CLSID_CMultiLanguage, NULL, CLSCTX_INPROC_SERVER, &IID_IMultiLanguage, (void **) &pIMultiLanguage);
+	REGISTER_PDO_CLASS_CONST_LONG("OLEDB_PARAM_DATETIME", (long)PDO_OLEDB_PARAM_DATETIME);
+	REGISTER_PDO_CLASS_CONST_LONG("OLEDB_PARAM_TABLE", (long)PDO_OLEDB_PARAM_TABLE);
 
-	return SUCCEEDED(hr) ? SUCCESS : FAILURE;
+	/* MDAC and MLang are started when first needed */
+	oledb_com_thread_startup(TSRMLS_C);
+
+	return SUCCESS;
 }
 /* }}} */
 
@@ -154,10 +243,16 @@ PHP_MSHUTDOWN_FUNCTION(pdo_oledb)
 		return FAILURE;
 	}
 
+	oledb_pool_shutdown();
+	UNREGISTER_INI_ENTRIES();
+
 	/* Not sure why a deadlock occurs here sometimes */
 	/*SAFE_RELEASE(pIDataInitialize);*/
 	SAFE_RELEASE(pIMultiLanguage);
-	CoUninitialize();
+#ifndef ZTS
+	/* without threads there's no one else to call the destructor */
+	oledb_globals_dtor(&pdo_oledb_globals TSRMLS_CC);
+#endif
 
 	_php_pdo_unregister_driver(&pdo_mssql_driver);
 	_php_pdo_unregister_driver(&pdo_oledb_driver);
@@ -168,7 +263,7 @@ PHP_MSHUTDOWN_FUNCTION(pdo_oledb)
 /* {{{ PHP_RINIT_FUNCTION */
 PHP_RINIT_FUNCTION(pdo_oledb)
 {
-	CoInitialize(NULL);
+	oledb_com_thread_startup(TSRMLS_C);
 	return SUCCESS;
 }
 /* }}} */
@@ -177,7 +272,6 @@ PHP_RINIT_FUNCTION(pdo_oledb)
  */
 PHP_RSHUTDOWN_FUNCTION(pdo_oledb)
 {
-	CoUninitialize();
 	return SUCCESS;
 }
 /* }}} */
@@ -295,7 +389,11 @@ PHP_MINFO_FUNCTION(pdo_oledb)
 		RELEASE(pIMultiLanguage);
 	}
 
+	oledb_pool_info();
+
 	php_info_print_table_end();
+
+	DISPLAY_INI_ENTRIES();
 }
 /* }}} */
 
@@ -309,7 +407,4 @@ pdo_raise_impl_error_proc _pdo_raise_impl_error;
 php_pdo_dbh_addref_proc _php_pdo_dbh_addref;
 php_pdo_dbh_delref_proc _php_pdo_dbh_delref;
 php_pdo_stmt_addref_proc _php_pdo_stmt_addref;
-php_pdo_stmt_delref_proc _php_pdo_stmt_delref;
-
-IDataInitialize *pIDataInitialize = NULL;
-IMultiLanguage *pIMultiLanguage = NULL;
\ No newline at end of file
+php_pdo_stmt_delref_proc _php_pdo_stmt_delref;
\ No newline at end of file
@@ -40,15 +40,11 @@ PHP_RINIT_FUNCTION(pdo_oledb);
 PHP_RSHUTDOWN_FUNCTION(pdo_oledb);
 PHP_MINFO_FUNCTION(pdo_oledb);
 
-/* 
-  	Declare any global variables you may need between the BEGIN
-	and END macros here:     
-
+/* per thread under ZTS--the destructor runs as the thread goes away */
 ZEND_BEGIN_MODULE_GLOBALS(pdo_oledb)
-	long  global_value;
-	char *global_string;
+	int comState;
+	DWORD comThreadId;
 ZEND_END_MODULE_GLOBALS(pdo_oledb)
-*/
 
 /* In every utility function you add that needs to use variables 
    in php_pdo_oledb_globals, call TSRMLS_FETCH(); after declaring other 
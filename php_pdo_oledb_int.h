@@ -54,10 +54,90 @@ typedef struct {
 	char *errmsg;
 } pdo_oledb_error_info;
 
+typedef ULONG DBLENGTH;
+
+typedef struct pdo_oledb_cached_statement {
+	struct pdo_oledb_cached_statement *prev;
+	struct pdo_oledb_cached_statement *next;
+	char *sql;
+	int sqlLen;
+	DB_UPARAMS paramCount;
+	DBPARAMINFO *paramInfo;
+	OLECHAR *paramNamesBuffer;
+	UINT paramNamesLen;
+	ICommand *pICommand;
+	HACCESSOR hAccessor;
+	DBBINDING *bindings;
+	DBCOUNTITEM bindingCount;
+	DBLENGTH rowSize;
+	int columnCount;
+} pdo_oledb_cached_statement;
+
+typedef struct {
+	int persistent;
+	long size;
+	long generation;
+	HashTable entries;
+	pdo_oledb_cached_statement *head;
+	pdo_oledb_cached_statement *tail;
+
+	long hits;
+	long misses;
+	long evictions;
+} pdo_oledb_statement_cache;
+
+typedef struct pdo_oledb_pooled_connection {
+	struct pdo_oledb_pooled_connection *next;
+	IDBProperties *pIDBProperties;
+	IDBCreateCommand *pIDBCreateCommand;
+	DWORD lastUsed;
+} pdo_oledb_pooled_connection;
+
+typedef struct pdo_oledb_connection_pool {
+	struct pdo_oledb_connection_pool *next;
+	char *key;
+	char *label;
+	pdo_oledb_pooled_connection *idle;
+	long idleCount;
+	long activeCount;
+
+	long hits;
+	long misses;
+	long failedChecks;
+	long trimmed;
+	long discarded;
+} pdo_oledb_connection_pool;
+
+typedef struct pdo_oledb_shared_data_source {
+	struct pdo_oledb_shared_data_source *next;
+	char *key;
+	IDBProperties *pIDBProperties;
+	long sessionCount;
+} pdo_oledb_shared_data_source;
+
+typedef struct pdo_oledb_cached_property {
+	struct pdo_oledb_cached_property *next;
+	char *key;
+	GUID propSetId;
+	DBPROPID propId;
+	BOOL supported;
+	VARIANT value;
+} pdo_oledb_cached_property;
+
+#define PDO_OLEDB_STATEMENT_CACHE_SIZE	64
+#define PDO_OLEDB_COMMAND_POOL_SIZE		4
+#define PDO_OLEDB_BATCH_MAX_STATEMENTS	100
+#define PDO_OLEDB_BATCH_MAX_BYTES		65536
+#define PDO_OLEDB_ASYNC_POLL_INTERVAL	10
+#define PDO_OLEDB_WATCHDOG_GRACE		2000
+
 typedef struct {
 	DWORD flags;
+	DWORD loginFlags;
 	long timeout;
 	char *appname;
+	long packetSize;
+	long negotiatedPacketSize;
 
 	IDBCreateCommand *pIDBCreateCommand;
 	IDBProperties *pIDBProperties;
@@ -65,12 +145,39 @@ typedef struct {
 	IMultiLanguage *pIMultiLanguage;
 	
 	pdo_oledb_conversion *conv;
+	pdo_oledb_statement_cache *cache;
+
+	/* set when the session came from (and goes back to) the connection pool */
+	char *poolKey;
+
+	/* provider CLSID and data source, for the capability cache */
+	char *providerKey;
+
+	/* logs in and opens the session--deferred to first use with lazy connect */
+	HRESULT (*connect)(pdo_dbh_t *dbh TSRMLS_DC);
+
+	/* read-only session on a secondary, opened when a statement is routed there */
+	char *readHost;
+	BOOL routeSelects;
+	BOOL readUnavailable;
+	IDBProperties *pIDBPropertiesRead;
+	IDBCreateCommand *pIDBCreateCommandRead;
+
+	/* commands for PDO::exec() and lastInsertId() */
+	ICommandText *pICommandTextPool[PDO_OLEDB_COMMAND_POOL_SIZE];
+	int commandPoolCount;
+
+	/* PDO::exec() statements waiting to be sent */
+	char *batch;
+	int batchLen;
+	int batchAlloc;
+	int batchCount;
+	BOOL batchSchemaChange;
+	long batchRowsAffected;
 
 	pdo_oledb_error_info einfo;
 } pdo_oledb_db_handle;
 
-typedef ULONG DBLENGTH;
-
 typedef struct {
 	char *columnName;
 	int columnNameLen;
@@ -107,6 +214,10 @@ typedef struct {
 
 typedef struct {
 	DWORD flags;
+	long timeout;
+	BOOL readOnly;
+	BOOL plainSelect;
+	BOOL onReadSession;
 	pdo_oledb_db_handle *H;
 	pdo_oledb_column *columns;
 
@@ -114,8 +225,21 @@ typedef struct {
 	ICommandWithParameters *pICommandWithParameters;
 	IAccessor *pIAccessorCommand;
 	HACCESSOR hAccessorCommand;
+	DBBINDING *commandBindings;
+	DBCOUNTITEM commandBindingCount;
+	DBLENGTH commandRowSize;
+
+	/* the same command on the other session--swapped in when a read is routed (or no longer can be) */
+	ICommand *pICommandAlt;
+	ICommandWithParameters *pICommandWithParametersAlt;
+	IAccessor *pIAccessorCommandAlt;
+	HACCESSOR hAccessorCommandAlt;
+	DBBINDING *commandBindingsAlt;
+	DBCOUNTITEM commandBindingCountAlt;
+	DBLENGTH commandRowSizeAlt;
 
 	IMultipleResults *pIMultipleResults;
+	IDBAsynchStatus *pIDBAsynchStatus;
 	IRowset *pIRowset;
 	IAccessor *pIAccessorRowset;
 	HACCESSOR hAccessorRowset;
@@ -128,6 +252,9 @@ typedef struct {
 	DBPARAMINFO	*paramInfo;
 	OLECHAR *paramNamesBuffer;
 	DBORDINAL paramOrdinal;
+	char *cacheKey;
+	int cacheKeyLen;
+	long cacheGeneration;
 
 	void *inputBuffer;
 	DBBYTEOFFSET nextInputOffset;
@@ -137,6 +264,9 @@ typedef struct {
 
 	pdo_oledb_conversion *conv;
 	pdo_oledb_error_info einfo;
+#ifdef PDO_OLEDB_TESTS
+	zval *standInResults;
+#endif
 } pdo_oledb_stmt;
 
 typedef struct {
@@ -153,7 +283,9 @@ typedef struct {
 	DBLENGTH byteOffset;
 
 	int intValue;
+	LONGLONG bigintValue;
 	double doubleValue;
+	DBTIMESTAMP timestampValue;
 	char *varcharValue;
 	BSTR unicodeValue;
     IUnknown *stream;
@@ -165,6 +297,7 @@ extern pdo_driver_t pdo_oledb_driver;
 extern pdo_driver_t pdo_mssql_driver;
 
 extern struct pdo_stmt_methods oledb_stmt_methods;
+extern zend_function_entry oledb_stmt_driver_methods[];
 
 void pdo_oledb_init_error_table(void);
 void pdo_oledb_fini_error_table(void);
@@ -182,10 +315,45 @@ enum {
 	PDO_OLEDB_ATTR_CHAR_ENCODING,
 	PDO_OLEDB_ATTR_AUTOTRANSLATE,
 	PDO_OLEDB_ATTR_TRUNCATE_STRING,
+	PDO_OLEDB_ATTR_STATEMENT_CACHE_SIZE,
+	PDO_OLEDB_ATTR_STATEMENT_CACHE_STATS,
+	PDO_OLEDB_ATTR_PERSISTENT_STATEMENT_CACHE,
+	PDO_OLEDB_ATTR_LAZY_PREPARE,
+	PDO_OLEDB_ATTR_BATCH_EXEC,
+	PDO_OLEDB_ATTR_BATCH_ROW_COUNT,
+	PDO_OLEDB_ATTR_NO_ROWSET,
+	PDO_OLEDB_ATTR_RESET_ON_REUSE,
+	PDO_OLEDB_ATTR_LAZY_CONNECT,
+	PDO_OLEDB_ATTR_PACKET_SIZE,
+	PDO_OLEDB_ATTR_BULK_TRANSFER,
+	PDO_OLEDB_ATTR_READ_ONLY,
+	PDO_OLEDB_ATTR_ROUTE_SELECTS,
 };
 
 #define PDO_OLEDB_CURSOR_SERVER_SIDE	0x80000000
 
+/* packet size picked by the driver: large for bulk transfer, the provider's default otherwise */
+#define PDO_OLEDB_PACKET_SIZE_AUTO		-1
+#define PDO_OLEDB_PACKET_SIZE_MIN		512
+#define PDO_OLEDB_PACKET_SIZE_MAX		32767
+#define PDO_OLEDB_BULK_PACKET_SIZE		32767
+
+/* driver-specific parameter types--kept clear of the PDO_PARAM_* range so PDO won't convert the value */
+enum {
+	PDO_OLEDB_PARAM_DATETIME = 0x0100,
+	PDO_OLEDB_PARAM_TABLE,
+};
+
+#ifndef DBTYPE_TABLE
+/* table-valued parameter (from sqlncli.h) */
+#define DBTYPE_TABLE	143
+#endif
+
+#ifndef SSPROP_INIT_APPLICATIONINTENT
+/* ApplicationIntent connection keyword (from sqlncli.h) */
+#define SSPROP_INIT_APPLICATIONINTENT	24
+#endif
+
 typedef PDO_API int (*php_pdo_register_driver_proc)(pdo_driver_t *driver);
 typedef PDO_API void (*php_pdo_unregister_driver_proc)(pdo_driver_t *driver);
 typedef PDO_API int (*php_pdo_parse_data_source_proc)(const char *data_source, unsigned long data_source_len, struct pdo_data_src_parser *parsed, int nparams);
@@ -210,8 +378,8 @@ extern php_pdo_dbh_delref_proc _php_pdo_dbh_delref;
 extern php_pdo_stmt_addref_proc _php_pdo_stmt_addref;
 extern php_pdo_stmt_delref_proc _php_pdo_stmt_delref;
 
-extern IDataInitialize *pIDataInitialize;
-extern IMultiLanguage *pIMultiLanguage;
+IDataInitialize *oledb_get_data_initialize(void);
+IMultiLanguage *oledb_get_multi_language(void);
 
 #define SAFE_STRING(s) ((s)?(s):"")
 
@@ -239,14 +407,59 @@ HRESULT oledb_convert_string(pdo_oledb_conversion *conv, LPCSTR src, UINT lenSrc
 
 UINT oledb_get_proper_truncated_length(LPCSTR s, UINT len, const char *charset);
 
+void oledb_create_statement_cache(pdo_oledb_statement_cache **pCache, long size, int persistent);
+void oledb_release_statement_cache(pdo_oledb_statement_cache *cache);
+void oledb_clear_statement_cache(pdo_oledb_statement_cache *cache);
+void oledb_resize_statement_cache(pdo_oledb_statement_cache *cache, long size);
+void oledb_release_idle_commands(pdo_oledb_statement_cache *cache);
+HRESULT oledb_find_cached_statement(pdo_oledb_statement_cache *cache, const char *sql, int sql_len, DB_UPARAMS *pCount, DBPARAMINFO **pInfo, OLECHAR **pNames);
+void oledb_add_cached_statement(pdo_oledb_statement_cache *cache, const char *sql, int sql_len, DB_UPARAMS count, DBPARAMINFO *info, OLECHAR *names);
+BOOL oledb_checkout_cached_command(pdo_oledb_statement_cache *cache, pdo_oledb_stmt *S, IUnknown *pSession);
+void oledb_return_cached_command(pdo_oledb_statement_cache *cache, pdo_oledb_stmt *S);
+void oledb_remove_cached_statement(pdo_oledb_statement_cache *cache, const char *sql, int sql_len);
+int oledb_get_cached_column_count(pdo_oledb_statement_cache *cache, const char *sql, int sql_len);
+void oledb_set_cached_column_count(pdo_oledb_statement_cache *cache, const char *sql, int sql_len, int count);
+void oledb_get_statement_cache_stats(pdo_oledb_statement_cache *cache, zval *val);
+char *oledb_normalize_statement(const char *sql, int sql_len, int *pLen);
+BOOL oledb_is_schema_change(const char *sql, int sql_len);
+BOOL oledb_is_data_modification(const char *sql, int sql_len);
+BOOL oledb_is_plain_select(const char *sql, int sql_len);
+
+void oledb_pool_startup(long max_size, long min_size, long idle_timeout, BOOL share);
+void oledb_pool_shutdown(void);
+char *oledb_pool_make_key(pdo_dbh_t *dbh, const char *driver_name);
+BOOL oledb_pool_checkout(const char *key, const char *label, IDBProperties **ppIDBProperties, IDBCreateCommand **ppIDBCreateCommand);
+void oledb_pool_attach(const char *key);
+void oledb_pool_checkin(const char *key, IDBProperties *pIDBProperties, IDBCreateCommand *pIDBCreateCommand);
+HRESULT oledb_open_read_session(pdo_dbh_t *dbh TSRMLS_DC);
+
+BOOL oledb_pool_is_enabled(void);
+IDBProperties *oledb_pool_get_data_source(const char *key);
+void oledb_pool_add_data_source(const char *key, IDBProperties *pIDBProperties);
+void oledb_pool_release_data_source(IDBProperties *pIDBProperties);
+BOOL oledb_pool_is_shared_data_source(IDBProperties *pIDBProperties);
+BOOL oledb_pool_get_property(const char *key, const GUID *prop_set_id, DBPROPID prop_id, BOOL *pSupported, VARIANT *pVar);
+void oledb_pool_set_property(const char *key, const GUID *prop_set_id, DBPROPID prop_id, BOOL supported, VARIANT *pVar);
+void oledb_pool_info(void);
+
 HRESULT oledb_create_lob_stream(pdo_oledb_conversion *conv, IUnknown *pUnk, DBLENGTH length, int conversion, pdo_stmt_t *stmt, php_stream **pStream TSRMLS_DC);
-HRESULT oledb_create_zval_stream(pdo_oledb_conversion *conv, zval *value, int unicode, IUnknown **pUnk, DBLENGTH *pLength TSRMLS_DC);
+HRESULT oledb_create_zval_stream(pdo_oledb_conversion *conv, zval *value, int conversion, IUnknown **pUnk, DBLENGTH *pLength TSRMLS_DC);
+HRESULT oledb_create_zval_rowset(pdo_oledb_conversion *conv, zval *value, IUnknown **pUnk TSRMLS_DC);
+#ifdef PDO_OLEDB_TESTS
+HRESULT oledb_create_test_results(pdo_stmt_t *stmt, zval *results, IMultipleResults **ppIMultipleResults TSRMLS_DC);
+long oledb_get_test_results_count(void);
+#endif
+
+zend_class_entry *oledb_get_datetime_ce(TSRMLS_D);
+char *oledb_datetime_to_str(DBTIMESTAMP *ts);
+HRESULT oledb_get_timestamp(zval *value, DBTIMESTAMP *ts TSRMLS_DC);
 
 extern void _pdo_oledb_error(pdo_dbh_t *dbh, pdo_stmt_t *stmt, HRESULT result, const char *file, int line TSRMLS_DC);
 #define pdo_oledb_error(h, hr) _pdo_oledb_error(h, NULL, hr, __FILE__, __LINE__ TSRMLS_CC)
 #define pdo_oledb_error_stmt(s, hr) _pdo_oledb_error(s->dbh, s, hr, __FILE__, __LINE__ TSRMLS_CC)
 
 void oledb_set_automation_error(LPCWSTR msg, LPCWSTR sqlcode);
+HRESULT oledb_flush_batch(pdo_dbh_t *dbh TSRMLS_DC);
 HRESULT oledb_set_internal_flag(long attr, zval *val, DWORD mask, DWORD *pFlags);
 HRESULT oledb_get_internal_flag(long attr, DWORD flags, zval *val);
 
@@ -256,6 +469,8 @@ HRESULT oledb_get_internal_flag(long attr, DWORD flags, zval *val);
 #define VARIABLE_LENGTH		(1 << 3)
 #define ALIESED_COLUMN		(1 << 4)
 #define TRUNCATE_STRING		(1 << 4)
+#define EMPTY_TABLE			(1 << 5)
+#define CACHED_COMMAND		(1 << 6)
 
 #define MULTIPLE_RESULTS	(1 << 7)
 
@@ -263,6 +478,10 @@ HRESULT oledb_get_internal_flag(long attr, DWORD flags, zval *val);
 #define CONNECTION_POOLING	(1 << 9)
 #define ENCRYPTION			(1 << 10)
 #define AUTOTRANSLATE		(1 << 11)
+#define PERSISTENT_CACHE	(1 << 12)
+#define LAZY_PREPARE		(1 << 13)
+#define PREPARE_PENDING		(1 << 14)
+#define EMULATE_PREPARES	(1 << 15)
 
 #define UNIQUE_ROWS			(1 << 16)
 #define ADD_TABLE_NAME		(1 << 17)
@@ -270,4 +489,20 @@ HRESULT oledb_get_internal_flag(long attr, DWORD flags, zval *val);
 #define CONVERT_DATE_TIME	(1 << 19)
 #define SCROLLABLE_CURSOR	(1 << 20)
 #define SERVER_SIDE_CURSOR	(1 << 21)
+#define BATCH_EXEC			(1 << 22)
+#define EXECUTE_ASYNC		(1 << 23)
+#define ASYNC_PENDING		(1 << 24)
+#define ASYNC_COMMAND		(1 << 25)
+#define ASYNC_DESCRIBE		(1 << 26)
+#define TIMEOUT_COMMAND		(1 << 27)
+#define NO_ROWSET			(1 << 28)
+#define COUNT_RESULTS		(1 << 29)
+
+/* login options, kept in H->loginFlags since statements don't inherit them */
+#define RESET_ON_REUSE		(1 << 0)
+#define LAZY_CONNECT		(1 << 1)
+#define BULK_TRANSFER		(1 << 2)
+
+/* options that are set as command properties */
+#define COMMAND_PROPERTY_FLAGS	(UNIQUE_ROWS | ADD_TABLE_NAME | ADD_CATALOG_NAME | SCROLLABLE_CURSOR | SERVER_SIDE_CURSOR)
 
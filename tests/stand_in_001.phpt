@@ -0,0 +1,41 @@
+--TEST--
+PDO_OLEDB: results with only a row count are skipped
+--SKIPIF--
+<?php require dirname(__FILE__) . '/skipif.inc'; ?>
+--FILE--
+<?php
+require dirname(__FILE__) . '/connect.inc';
+
+$stmt = $db->prepare('SELECT 1');
+$stmt->oledbExecuteStandIn(array(
+	3,
+	array(array('a' => 'p'), array('a' => 'q')),
+	4,
+	5,
+	array(array('b' => 'x')),
+	6,
+));
+do {
+	var_dump($stmt->fetchAll(PDO::FETCH_ASSOC));
+} while ($stmt->nextRowset());
+?>
+--EXPECT--
+array(2) {
+  [0]=>
+  array(1) {
+    ["a"]=>
+    string(1) "p"
+  }
+  [1]=>
+  array(1) {
+    ["a"]=>
+    string(1) "q"
+  }
+}
+array(1) {
+  [0]=>
+  array(1) {
+    ["b"]=>
+    string(1) "x"
+  }
+}
@@ -0,0 +1,29 @@
+--TEST--
+PDO_OLEDB: rowCount() picks up the counts of skipped results
+--SKIPIF--
+<?php require dirname(__FILE__) . '/skipif.inc'; ?>
+--FILE--
+<?php
+require dirname(__FILE__) . '/connect.inc';
+
+$stmt = $db->prepare('SELECT 1');
+$stmt->oledbExecuteStandIn(array(
+	3,
+	array(array('a' => 'p')),
+	4,
+	5,
+	array(array('a' => 'q')),
+	6,
+));
+var_dump($stmt->rowCount());
+var_dump($stmt->nextRowset());
+var_dump($stmt->rowCount());
+var_dump($stmt->nextRowset());
+var_dump($stmt->rowCount());
+?>
+--EXPECT--
+int(3)
+bool(true)
+int(5)
+bool(false)
+int(6)
@@ -0,0 +1,33 @@
+--TEST--
+PDO_OLEDB: the results object is released once the last result is read
+--SKIPIF--
+<?php require dirname(__FILE__) . '/skipif.inc'; ?>
+--FILE--
+<?php
+require dirname(__FILE__) . '/connect.inc';
+
+$stmt = $db->prepare('SELECT 1');
+$stmt->oledbExecuteStandIn(array(
+	array(array('a' => 'p')),
+	array(array('a' => 'q')),
+	7,
+));
+var_dump($stmt->oledbOpenStandIns());
+var_dump($stmt->nextRowset());
+var_dump($stmt->oledbOpenStandIns());
+var_dump($stmt->nextRowset());
+var_dump($stmt->oledbOpenStandIns());
+
+/* nothing but row counts--there's nothing to hold on to after execute */
+$stmt->oledbExecuteStandIn(array(1, 2));
+var_dump($stmt->oledbOpenStandIns());
+var_dump($stmt->rowCount());
+?>
+--EXPECT--
+int(1)
+bool(true)
+int(1)
+bool(false)
+int(0)
+int(0)
+int(2)
@@ -0,0 +1,28 @@
+--TEST--
+PDO_OLEDB: output parameters are synced only after the last result
+--SKIPIF--
+<?php require dirname(__FILE__) . '/skipif.inc'; ?>
+--FILE--
+<?php
+require dirname(__FILE__) . '/connect.inc';
+
+$stmt = $db->prepare("EXEC sp_executesql N'SET @o = 1', N'@o int OUTPUT', @o = ? OUTPUT");
+$out = -1;
+$stmt->bindParam(1, $out, PDO::PARAM_INT | PDO::PARAM_INPUT_OUTPUT, 4);
+$stmt->oledbExecuteStandIn(array(
+	array(array('a' => 'p')),
+	2,
+	array(array('a' => 'q')),
+));
+var_dump($out);
+var_dump($stmt->nextRowset());
+var_dump($out);
+var_dump($stmt->nextRowset());
+var_dump($out);
+?>
+--EXPECT--
+int(-1)
+bool(true)
+int(-1)
+bool(false)
+NULL
@@ -0,0 +1,36 @@
+--TEST--
+PDO_OLEDB: closeCursor() lets go of pending results
+--SKIPIF--
+<?php require dirname(__FILE__) . '/skipif.inc'; ?>
+--FILE--
+<?php
+require dirname(__FILE__) . '/connect.inc';
+
+$stmt = $db->prepare('SELECT 1');
+$stmt->oledbExecuteStandIn(array(
+	array(array('a' => 'p'), array('a' => 'q')),
+	array(array('a' => 'r')),
+));
+var_dump($stmt->fetch(PDO::FETCH_ASSOC));
+var_dump($stmt->oledbOpenStandIns());
+var_dump($stmt->closeCursor());
+var_dump($stmt->oledbOpenStandIns());
+var_dump($stmt->nextRowset());
+
+/* the statement can be run again afterward */
+$stmt->oledbExecuteStandIn(array(array(array('a' => 's'))));
+var_dump($stmt->fetchAll(PDO::FETCH_COLUMN));
+?>
+--EXPECT--
+array(1) {
+  ["a"]=>
+  string(1) "p"
+}
+int(1)
+bool(true)
+int(0)
+bool(false)
+array(1) {
+  [0]=>
+  string(1) "s"
+}